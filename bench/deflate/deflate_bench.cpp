@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+/*  Measures the size and the throughput of the compressor over the
+    compression levels and options, on generated inputs or on the
+    files named on the command line:
+
+        deflate-bench [file...]
+
+    Each configuration is timed as the best of several runs, which
+    is the most stable figure on a loaded machine.
+*/
+
+#include <boost/deflate/deflate_stream.hpp>
+#include <boost/deflate/error.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace boost::deflate;
+
+struct input
+{
+    std::string name;
+    std::string data;
+};
+
+// A compressor configuration to measure
+struct config
+{
+    std::string name;
+    int level;
+    std::function<void(deflate_stream&)> setup;
+};
+
+// Words from a vocabulary with a skewed distribution, like prose
+std::string
+make_text(std::size_t n)
+{
+    static char const* const syllables[] = {
+        "an", "ber", "co", "de", "en", "fi", "ga", "ho", "in", "jo",
+        "ka", "lu", "me", "no", "or", "pa", "qui", "re", "st", "ti" };
+    std::mt19937 g;
+    std::vector<std::string> words(2000);
+    for(auto& w : words)
+        for(auto k = 1 + g() % 4; k > 0; --k)
+            w += syllables[g() % 20];
+    std::string s;
+    s.reserve(n + 100);
+    while(s.size() < n)
+    {
+        // the product of two uniform picks favours the first words
+        s += words[(g() % 2000) * (g() % 2000) / 2000];
+        s += g() % 12 == 0 ? ".\n" : " ";
+    }
+    s.resize(n);
+    return s;
+}
+
+// Fixed size records of counters, codes and noise, like a table
+std::string
+make_binary(std::size_t n)
+{
+    std::string s;
+    s.reserve(n + 16);
+    std::mt19937 g;
+    std::uint32_t id = 0;
+    while(s.size() < n)
+    {
+        id += 1 + g() % 3;
+        for(int i = 0; i < 4; ++i)
+            s.push_back(static_cast<char>(id >> (8 * i)));
+        s.push_back(static_cast<char>(g() % 16));
+        s.append(2, static_cast<char>(g() % 8 == 0 ? g() : 0));
+        for(int i = 0; i < 3; ++i)
+            s.push_back(static_cast<char>(g() % 256));
+        s.append("\0\0\x80\x3f", 4);
+        s.push_back(static_cast<char>(g() % 4));
+    }
+    s.resize(n);
+    return s;
+}
+
+// Compress all of in, returning the size of the output
+std::size_t
+compress(
+    deflate_stream& ds,
+    config const& c,
+    std::string const& in,
+    std::string& out)
+{
+    ds.reset();
+    // after reset, since tune only lasts until the next one
+    if(c.setup)
+        c.setup(ds);
+    z_params zp{};
+    zp.next_in = in.data();
+    zp.avail_in = in.size();
+    zp.next_out = &out[0];
+    zp.avail_out = out.size();
+    error_code ec;
+    ds.write(zp, Flush::finish, ec);
+    if(ec != error::end_of_stream)
+    {
+        std::cerr << "deflate: " << ec.message() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return zp.total_out;
+}
+
+void
+run(input const& in, std::vector<config> const& configs, int runs)
+{
+    std::printf("%s, %zu bytes\n", in.name.c_str(), in.data.size());
+    std::printf("  %-20s %10s %8s %10s\n",
+        "config", "size", "ratio", "MB/s");
+    for(auto const& c : configs)
+    {
+        deflate_stream ds;
+        ds.reset(c.level, 15, 8, Strategy::normal);
+        std::string out;
+        out.resize(ds.upper_bound(in.data.size()));
+        std::size_t size = 0;
+        double best = 0;
+        for(int i = 0; i < runs; ++i)
+        {
+            auto const t0 = std::chrono::steady_clock::now();
+            size = compress(ds, c, in.data, out);
+            auto const t1 = std::chrono::steady_clock::now();
+            double const secs =
+                std::chrono::duration<double>(t1 - t0).count();
+            if(i == 0 || secs < best)
+                best = secs;
+        }
+        std::printf("  %-20s %10zu %8.3f %10.1f\n",
+            c.name.c_str(), size,
+            static_cast<double>(in.data.size()) / size,
+            in.data.size() / best / 1e6);
+    }
+}
+
+} // (anon)
+
+int
+main(int argc, char** argv)
+{
+    std::vector<input> inputs;
+    if(argc > 1)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            std::ifstream f(argv[i], std::ios::binary);
+            if(! f)
+            {
+                std::cerr << argv[i] << ": cannot open" << std::endl;
+                return EXIT_FAILURE;
+            }
+            inputs.push_back({argv[i], std::string(
+                std::istreambuf_iterator<char>(f),
+                std::istreambuf_iterator<char>())});
+        }
+    }
+    else
+    {
+        inputs.push_back({"text", make_text(4000000)});
+        inputs.push_back({"binary", make_binary(4000000)});
+
+        // Alternating parts, as in an archive of small files
+        std::string mixed;
+        auto const text = make_text(2000000);
+        auto const binary = make_binary(2000000);
+        for(std::size_t i = 0; i < 2000000; i += 100000)
+        {
+            mixed.append(text, i, 100000);
+            mixed.append(binary, i, 100000);
+        }
+        inputs.push_back({"mixed", std::move(mixed)});
+    }
+
+    std::vector<config> configs;
+    for(int level = 1; level <= 9; ++level)
+        configs.push_back({"level " + std::to_string(level), level, {}});
+
+    // The medium compressor against the lazy evaluation
+    for(int level = 4; level <= 6; ++level)
+        configs.push_back({"level " + std::to_string(level) + " medium",
+            level, [](deflate_stream& ds) { ds.medium(true); }});
+
+    // Blocks ended where the data changes
+    for(int level : { 1, 6, 9 })
+        configs.push_back({"level " + std::to_string(level) + " split",
+            level, [](deflate_stream& ds) { ds.block_split(true); }});
+
+    // Matches of four bytes or more at the fast levels, which are
+    // tuned with their own good, lazy, nice and chain parameters
+    static int const fast[3][4] = {
+        { 4, 4,  8,  4 }, { 4, 5, 16,  8 }, { 4, 6, 32, 32 } };
+    for(int level = 1; level <= 3; ++level)
+        configs.push_back({"level " + std::to_string(level) + " min 4",
+            level, [level](deflate_stream& ds)
+            {
+                auto const& t = fast[level - 1];
+                ds.tune(t[0], t[1], t[2], t[3], 4);
+            }});
+
+    for(auto const& in : inputs)
+        run(in, configs, 5);
+}
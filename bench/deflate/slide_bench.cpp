@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+/*  Measures the cost of sliding the hash table with each kernel,
+    apart from the rest of the compressor:
+
+        slide-bench
+
+    With a 32KB window the compressor slides the head and prev
+    tables once for every 32KB of input, so the time per MiB is
+    32 slides of both tables.
+*/
+
+#include <boost/deflate/detail/slide_hash.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace boost::deflate::detail;
+
+std::size_t constexpr wsize = 32768;
+
+// The head table at memLevel 8, and prev with the binary tree's size
+std::size_t constexpr head_size = 32768;
+std::size_t constexpr prev_size = 2 * wsize;
+
+void
+run(char const* name, slide_hash_kernel k)
+{
+    std::vector<std::uint16_t> head(head_size);
+    std::vector<std::uint16_t> prev(prev_size);
+    std::mt19937 g;
+    double best = 0;
+    for(int i = 0; i < 5; ++i)
+    {
+        // Positions from the upper half of the window, as after a fill
+        for(auto& m : head)
+            m = static_cast<std::uint16_t>(g() % (2 * wsize));
+        for(auto& m : prev)
+            m = static_cast<std::uint16_t>(g() % (2 * wsize));
+        int constexpr slides = 1000;
+        auto const t0 = std::chrono::steady_clock::now();
+        for(int j = 0; j < slides; ++j)
+        {
+            k(head.data(), head.size(), wsize);
+            k(prev.data(), prev.size(), wsize);
+        }
+        auto const t1 = std::chrono::steady_clock::now();
+        double const ns = std::chrono::duration<double,
+            std::nano>(t1 - t0).count() / slides;
+        if(i == 0 || ns < best)
+            best = ns;
+    }
+    std::printf("  %-10s %12.0f %12.1f\n",
+        name, best, best * (1048576 / wsize) / 1000);
+}
+
+} // (anon)
+
+int
+main()
+{
+    std::printf("  %-10s %12s %12s\n", "kernel", "ns/slide", "us/MiB");
+    run("scalar", &slide_hash_scalar);
+#ifdef BOOST_DEFLATE_USE_SSE2
+    run("sse2", &slide_hash_sse2);
+#endif
+#if defined(BOOST_DEFLATE_USE_AVX2)
+    run("avx2", &slide_hash_avx2);
+#elif defined(BOOST_DEFLATE_DETECT_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+        run("avx2", &slide_hash_avx2);
+#endif
+    run("selected", select_slide_hash());
+}
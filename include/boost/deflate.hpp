@@ -11,10 +11,14 @@
 #define BOOST_DEFLATE_HPP
 
 #include <boost/deflate/config.hpp>
+#include <boost/deflate/basic_deflate_stream.hpp>
+#include <boost/deflate/basic_inflate_stream.hpp>
 
 #include <boost/deflate/deflate_stream.hpp>
 #include <boost/deflate/error.hpp>
 #include <boost/deflate/inflate_stream.hpp>
+#include <boost/deflate/parallel_deflate.hpp>
+#include <boost/deflate/prepared_dictionary.hpp>
 #include <boost/deflate/deflate.hpp>
 
 #endif
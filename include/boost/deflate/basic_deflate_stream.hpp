@@ -0,0 +1,233 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_BASIC_DEFLATE_STREAM_HPP
+#define BOOST_DEFLATE_BASIC_DEFLATE_STREAM_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <boost/deflate/deflate.hpp>
+#include <boost/deflate/deflate_stream.hpp>
+#include <boost/deflate/error.hpp>
+#include <boost/deflate/prepared_dictionary.hpp>
+#include <boost/deflate/detail/deflate_stream.hpp>
+#include <boost/throw_exception.hpp>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+namespace boost {
+namespace deflate {
+
+/** Deflate compressor with parameters fixed at compile time.
+
+    The format, the window size and the compression engine are
+    template parameters, so the compressor is compiled with them
+    as constants: the window masks are immediate values, the
+    checksum is chosen without a branch, and the engine is called
+    directly. The match finder is the rolling hash with hash
+    chains, so the output is identical to that of a
+    @ref deflate_stream with the same settings.
+
+    @tparam Wrap The format, one of @ref policy::raw,
+    @ref policy::zlib or @ref policy::gzip.
+
+    @tparam WindowBits The base two logarithm of the window
+    size, from 9 to 15.
+
+    @tparam Engine The compression engine, one of
+    @ref policy::stored, @ref policy::fast or @ref policy::lazy,
+    which limits the compression level to the levels which use it.
+
+    The specialization with @ref policy::dynamic for every
+    parameter is @ref deflate_stream, where they are given
+    at run time.
+*/
+template<class Wrap, int WindowBits, class Engine>
+class basic_deflate_stream
+    : private detail::deflate_stream
+{
+    static_assert(! std::is_same<Wrap, policy::dynamic>::value &&
+        WindowBits != policy::dynamic_window_bits &&
+        ! std::is_same<Engine, policy::dynamic>::value,
+        "Parameters are either all static, or all dynamic");
+
+    static_assert(WindowBits >= 9 && WindowBits <= 15,
+        "WindowBits must be from 9 to 15");
+
+    using params = detail::deflate_stream::params<
+        static_cast<int>(Wrap::value), WindowBits>;
+
+public:
+    /// The format of the stream
+    static constexpr wrap format = Wrap::value;
+
+    /// The base two logarithm of the window size
+    static constexpr int window_bits = WindowBits;
+
+    /** Construct a deflate stream.
+
+        The level is the default level of the engine, the
+        memory level is the default of @ref deflate_stream
+        and the strategy is `Strategy::normal`.
+    */
+    basic_deflate_stream()
+    {
+        reset(Engine::default_level,
+            default_mem_level, Strategy::normal);
+    }
+
+    /** Reset the stream and compression settings.
+
+        The parameters have the same meaning as those of
+        @ref deflate_stream::reset.
+
+        @throws std::invalid_argument if the level is not one of
+        the levels of the engine, if the memory level is out of
+        range, or if the strategy needs another engine. Only
+        `Strategy::normal`, `Strategy::filtered` and
+        `Strategy::fixed` are supported.
+    */
+    void
+    reset(int level, int memLevel, Strategy strategy)
+    {
+        if(level == default_size)
+            level = Engine::default_level;
+        if(level < Engine::min_level || level > Engine::max_level)
+            BOOST_THROW_EXCEPTION(std::invalid_argument{
+                "invalid level"});
+        if( strategy != Strategy::normal &&
+            strategy != Strategy::filtered &&
+            strategy != Strategy::fixed)
+            BOOST_THROW_EXCEPTION(std::invalid_argument{
+                "invalid strategy"});
+        doReset(level, WindowBits, memLevel, strategy, format);
+    }
+
+    /** Reset the stream without deallocating memory.
+
+        @see deflate_stream::reset
+    */
+    void
+    reset()
+    {
+        doReset();
+    }
+
+    /** Clear the stream.
+
+        @see deflate_stream::clear
+    */
+    void
+    clear()
+    {
+        doClear();
+    }
+
+    /** Returns the upper limit on the size of a compressed block.
+
+        @see deflate_stream::upper_bound
+    */
+    std::size_t
+    upper_bound(std::size_t sourceLen) const
+    {
+        return doUpperBound(sourceLen);
+    }
+
+    /** Fine tune internal compression parameters.
+
+        @see deflate_stream::tune
+    */
+    void
+    tune(
+        int good_length,
+        int max_lazy,
+        int nice_length,
+        int max_chain)
+    {
+        doTune(good_length, max_lazy, nice_length, max_chain, min_match);
+    }
+
+    /// Return the statistics collected since the last reset
+    deflate_stats const&
+    stats() const noexcept
+    {
+        return stats_;
+    }
+
+    /** Compress input and write output.
+
+        @see deflate_stream::write
+    */
+    void
+    write(
+        z_params& zs,
+        Flush flush,
+        error_code& ec)
+    {
+        doWrite(zs, flush, ec, engine_func<params>(Engine{}));
+    }
+
+    /** Set a preset dictionary.
+
+        @see deflate_stream::set_dictionary
+    */
+    void
+    set_dictionary(
+        void const* data,
+        std::size_t size,
+        error_code& ec)
+    {
+        doDictionary(static_cast<Byte const*>(data), size, ec);
+    }
+
+    /** Set a prepared preset dictionary.
+
+        @see deflate_stream::set_dictionary
+    */
+    void
+    set_dictionary(
+        prepared_dictionary const& dict,
+        error_code& ec)
+    {
+        doDictionary(dict, ec);
+    }
+
+    /** Return bits pending in the output.
+
+        @see deflate_stream::pending
+    */
+    void
+    pending(unsigned *value, int *bits)
+    {
+        doPending(value, bits);
+    }
+
+    /** Insert bits into the compressed output stream.
+
+        @see deflate_stream::prime
+    */
+    void
+    prime(int bits, int value, error_code& ec)
+    {
+        doPrime(bits, value, ec);
+    }
+};
+
+/// The deflate stream with every parameter given at run time
+template<>
+class basic_deflate_stream<
+    policy::dynamic, policy::dynamic_window_bits, policy::dynamic>
+    : public deflate_stream
+{
+};
+
+} // deflate
+} // boost
+
+#endif
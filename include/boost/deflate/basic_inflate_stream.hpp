@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_BASIC_INFLATE_STREAM_HPP
+#define BOOST_DEFLATE_BASIC_INFLATE_STREAM_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <boost/deflate/deflate.hpp>
+#include <boost/deflate/error.hpp>
+#include <boost/deflate/inflate_stream.hpp>
+#include <boost/deflate/detail/inflate_stream.hpp>
+#include <type_traits>
+
+namespace boost {
+namespace deflate {
+
+/** Deflate decompressor with parameters fixed at compile time.
+
+    The format and the window size are template parameters,
+    and cannot be changed by @ref reset. The decoder itself
+    does not branch on either in its inner loop, so this only
+    fixes the configuration of the stream.
+
+    @tparam Wrap The format, one of @ref policy::raw,
+    @ref policy::zlib or @ref policy::gzip.
+
+    @tparam WindowBits The base two logarithm of the window
+    size, from 8 to 15.
+
+    The specialization with @ref policy::dynamic for every
+    parameter is @ref inflate_stream, where they are given
+    at run time.
+*/
+template<class Wrap, int WindowBits>
+class basic_inflate_stream
+    : private detail::inflate_stream
+{
+    static_assert(! std::is_same<Wrap, policy::dynamic>::value &&
+        WindowBits != policy::dynamic_window_bits,
+        "Parameters are either all static, or all dynamic");
+
+    static_assert(WindowBits >= 8 && WindowBits <= 15,
+        "WindowBits must be from 8 to 15");
+
+public:
+    /// The format of the stream
+    static constexpr wrap format = Wrap::value;
+
+    /// The base two logarithm of the window size
+    static constexpr int window_bits = WindowBits;
+
+    /// Construct a decompression stream.
+    basic_inflate_stream()
+    {
+        reset();
+    }
+
+    /** Reset the stream.
+
+        This puts the stream in a newly constructed state without
+        de-allocating any dynamically created structures.
+
+        @param validate_checksum `true` to check the trailing
+        checksum of the zlib and gzip formats.
+    */
+    void
+    reset(bool validate_checksum = true)
+    {
+        doReset(WindowBits, format, validate_checksum);
+    }
+
+    /** Put the stream in a newly constructed state.
+
+        All dynamically allocated memory is de-allocated.
+    */
+    void
+    clear()
+    {
+        doClear();
+    }
+
+    /** Decompress input and produce output.
+
+        @see inflate_stream::write
+    */
+    void
+    write(z_params& zs, Flush flush, error_code& ec)
+    {
+        doWrite(zs, flush, ec);
+    }
+};
+
+/// The inflate stream with every parameter given at run time
+template<>
+class basic_inflate_stream<
+    policy::dynamic, policy::dynamic_window_bits>
+    : public inflate_stream
+{
+};
+
+} // deflate
+} // boost
+
+#endif
@@ -181,6 +181,8 @@ enum compression
     none         =  0,
     best_speed   =  1,
     best_size    =  9,
+    optimal_size = 10, // first level using the optimal parser
+    max_level    = 12,
     default_size = -1
 };
 
@@ -224,7 +226,188 @@ enum class Strategy
         This strategy prevents the use of dynamic Huffman codes,
         allowing for a simpler decoder for special applications.
     */
-    fixed
+    fixed,
+
+    /** Quick strategy.
+
+        This strategy is for maximum speed, for example for data
+        which is compressed as it is produced. Each position probes
+        a single entry of a hash table of four byte strings, and
+        the literals and matches are written immediately with the
+        static Huffman codes. The compression level is ignored.
+        Incompressible input grows by up to one eighth.
+    */
+    quick,
+
+    /** Adaptive strategy.
+
+        This strategy chooses how to compress each chunk of the
+        input from a sample of its bytes: runs of bytes are
+        compressed as with @ref rle, bytes without repeated strings
+        as with @ref huffman, bytes which Huffman codes do not
+        shrink are stored, and other bytes are compressed as with
+        @ref normal at the compression level. This suits streams
+        which mix text with already compressed data. A block ends
+        where the choice changes.
+    */
+    adaptive
+};
+
+/** Hash function used by the compressor's match finder.
+
+    These are used when compressing streams.
+*/
+enum class Hash
+{
+    /** Rolling hash.
+
+        This is the shift and xor hash of zlib over three
+        bytes. It produces output identical to zlib.
+    */
+    rolling,
+
+    /** Multiplicative hash.
+
+        This is a Fibonacci hash of four bytes. It spreads
+        binary data more evenly over the hash table, which
+        gives shorter chains at the cost of no longer finding
+        some matches of length three.
+    */
+    multiplicative,
+
+    /** CRC-32C hash.
+
+        This hashes four bytes with the CRC-32C instruction of
+        SSE 4.2. When the instruction is not available in the
+        build, the multiplicative hash is used instead.
+    */
+    crc32c
+};
+
+/** Data structure used by the compressor's match finder.
+
+    These are used when compressing streams.
+*/
+enum class MatchFinder
+{
+    /** Choose by level.
+
+        Levels up to 9 use hash chains, so they produce output
+        identical to zlib, and the higher levels use the binary
+        tree.
+    */
+    automatic,
+
+    /** Hash chains.
+
+        Each string is linked to the previous string with the
+        same hash, and the chain is searched from the most
+        recent string for the longest match. This is the match
+        finder of zlib.
+    */
+    hash_chain,
+
+    /** Binary tree.
+
+        The strings with the same hash form a binary search tree
+        sorted by their suffixes, which is rebuilt around each new
+        string as it is inserted. A search only visits strings
+        which share a prefix with the new one, so it finds every
+        match which is longer than those before it in a bounded
+        number of steps, even on highly repetitive input. The tree
+        needs twice the memory of the chains.
+    */
+    binary_tree
+};
+
+/** Compile-time parameters of @ref basic_deflate_stream and
+    @ref basic_inflate_stream.
+
+    A stream whose parameters are all fixed at compile time
+    is compiled with them as constants, without branches on
+    the format or the engine.
+*/
+namespace policy {
+
+/// A parameter which is given at run time, as to @ref deflate_stream
+struct dynamic {};
+
+/// Selects a window size given at run time
+static constexpr int dynamic_window_bits = 0;
+
+/// Raw deflate data, without a wrapper
+struct raw
+{
+    static constexpr wrap value = wrap::none;
+};
+
+/// The zlib format
+struct zlib
+{
+    static constexpr wrap value = wrap::zlib;
+};
+
+/// The gzip format
+struct gzip
+{
+    static constexpr wrap value = wrap::gzip;
+};
+
+/// Stored blocks only, compression level 0
+struct stored
+{
+    static constexpr int min_level = 0;
+    static constexpr int max_level = 0;
+    static constexpr int default_level = 0;
+};
+
+/// Greedy matching, compression levels 1 to 3
+struct fast
+{
+    static constexpr int min_level = 1;
+    static constexpr int max_level = 3;
+    static constexpr int default_level = 1;
+};
+
+/// Lazy matching, compression levels 4 to 9
+struct lazy
+{
+    static constexpr int min_level = 4;
+    static constexpr int max_level = 9;
+    static constexpr int default_level = 6;
+};
+
+} // policy
+
+/** Statistics collected by a deflate stream.
+
+    The counters are cleared when the stream is reset, and
+    can be used to measure the effect of the compression
+    level, the strategy and the hash function on the work
+    done by the compressor, and to see which type of block
+    it chose. When `BOOST_DEFLATE_NO_MATCH_STATS` is defined,
+    the counters of the match finder are not kept and stay
+    zero, which takes their updates out of the searches.
+*/
+struct deflate_stats
+{
+    /// The number of searches made by the match finder.
+    std::size_t searches = 0;
+
+    /// The number of hash chain entries examined by all searches.
+    std::size_t chain_links = 0;
+
+    /// The largest number of hash chain entries examined by one search.
+    std::size_t max_chain = 0;
+
+    /// The number of blocks sent stored, without compression.
+    std::size_t stored_blocks = 0;
+
+    /// The number of blocks sent with the static Huffman codes.
+    std::size_t static_blocks = 0;
+
+    /// The number of blocks sent with their own Huffman codes.
+    std::size_t dynamic_blocks = 0;
 };
 
 } // deflate
@@ -89,6 +89,13 @@ public:
         This function initializes the stream to the specified
         compression settings.
 
+        Levels 1 through 9 trade speed for size as in zlib. Levels
+        10 through 12 choose matches with an iterated cost model
+        instead of lazy evaluation, and by default find them with
+        the binary tree match finder. They produce smaller output at
+        many times the cost of level 9, and are meant for data which
+        is compressed once and decompressed often.
+
         Although the stream is ready to be used immediately
         after a reset, any required internal buffers are not
         dynamically allocated until needed.
@@ -162,15 +169,217 @@ public:
         for their specific input data. Read the deflate.c source code
         (ZLib) for the meaning of the max_lazy, good_length, nice_length,
         and max_chain parameters.
+
+        The parameters apply until the next call to @ref reset, or to
+        @ref params with a different level.
+
+        @param min_length The shortest match sent by the fast levels 1
+        to 3, either 3 or 4. With 4 they hash strings of four bytes
+        instead of three, using `Hash::multiplicative` in place of
+        `Hash::rolling`, so the hash chains hold fewer strings which
+        only share three bytes, and matches of three bytes are sent as
+        literals. The chains are shorter, and on most data the
+        output is smaller too, since short matches cost nearly as
+        much as their literals, but the effect depends on the data.
+        The output is no longer identical to zlib. The default is 3.
+
+        @throws std::invalid_argument if `min_length` is not 3 or 4,
+        or is 4 at a level other than 1 to 3.
     */
     void
     tune(
         int good_length,
         int max_lazy,
         int nice_length,
-        int max_chain)
+        int max_chain,
+        int min_length = 3)
+    {
+        doTune(good_length, max_lazy, nice_length, max_chain, min_length);
+    }
+
+    /** Select the hash function used by the match finder.
+
+        The default is `Hash::rolling`, which produces the same
+        output as zlib. The setting is kept across calls to
+        @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    hash(Hash h)
+    {
+        doHash(h);
+    }
+
+    /** Select the match finder.
+
+        The default is `MatchFinder::automatic`, which uses hash
+        chains for levels up to 9 and the binary tree above. The
+        match finder is chosen when the stream is initialized with
+        the level in effect then, and a later change of level with
+        @ref params keeps it. The setting is kept across calls to
+        @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    match_finder(MatchFinder f)
+    {
+        doMatchFinder(f);
+    }
+
+    /** Select the medium compressor for levels 4 to 6.
+
+        When enabled, levels 4 to 6 replace the lazy evaluation of
+        zlib with a single search per match, followed by a search
+        at the end of the match whose result is moved back over it
+        where the bytes agree. This is faster, at the cost of
+        slightly larger output which is no longer identical to
+        zlib. The default is off, and the setting is kept across
+        calls to @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    medium(bool on)
+    {
+        doMedium(on);
+    }
+
+    /** Select whether blocks end where the data changes.
+
+        By default a block ends only when its buffer of symbols is
+        full, or on a flush. When enabled, the distribution of the
+        symbols is watched as they are produced, and the block is
+        ended early when it shifts, for example at the boundary of
+        text and binary data, so that each part gets its own Huffman
+        codes. The cost is small, and the output is no longer
+        identical to zlib. The default is off. The setting takes
+        effect immediately and is kept across calls to @ref reset.
+    */
+    void
+    block_split(bool on)
+    {
+        doBlockSplit(on);
+    }
+
+    /** Select whether blocks may repeat the Huffman codes of a previous block.
+
+        By default the codes of each block are built from its own
+        symbols. When enabled, the codes of the last block sent with
+        new codes are sent again, when they code the symbols of the
+        current block within a small margin of what new codes would.
+        This saves building the codes and their description for
+        data whose statistics change little from block to block,
+        such as logs, at the cost of slightly larger output which
+        is no longer identical to zlib. The default is off. The
+        setting takes effect immediately and is kept across calls
+        to @ref reset.
+    */
+    void
+    reuse_trees(bool on)
+    {
+        doReuseTrees(on);
+    }
+
+    /** Select whether blocks hold more symbols.
+
+        By default a block ends when it holds `1 << (memLevel + 6)`
+        literals and matches, as in zlib, and their buffer shares
+        its memory with the pending output. When enabled, a block
+        holds sixteen times as many symbols, in a buffer of its own
+        which takes `7 << (memLevel + 10)` bytes in all. Large
+        homogeneous inputs then send fewer Huffman code descriptions
+        and spend less time building them, at the cost of memory and
+        of slower adaptation to changes in the data. The output is
+        no longer identical to zlib, and incompressible data grows
+        by up to the bound for non default parameters of
+        @ref upper_bound. The default is off, and the setting is
+        kept across calls to @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    large_blocks(bool on)
+    {
+        doLargeBlocks(on);
+    }
+
+    /** Select whether incompressible input is stored without searching it.
+
+        By default every byte is hashed and searched for matches,
+        and only then is a block found not to shrink and sent
+        stored. When enabled, each chunk of 32K input bytes is first
+        sampled at both ends as with `Strategy::adaptive`, and a
+        chunk with almost no repeated strings whose bytes are spread
+        too evenly for Huffman codes to gain is stored without
+        hashing it. Already compressed data such as images passes
+        through many times faster. This applies to levels 1 and up
+        of the strategies which search for matches. The output is no
+        longer identical to zlib. The default is off, and the setting
+        is kept across calls to @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    store_incompressible(bool on)
     {
-        doTune(good_length, max_lazy, nice_length, max_chain);
+        doStoreIncompressible(on);
+    }
+
+    /** Select whether the match finder uses 32 bit positions.
+
+        By default the hash chains hold 16 bit window indices, as
+        in zlib, so each time the window slides the whole window
+        is copied down by half and every entry of the hash chains
+        is moved. When enabled, the chains hold 32 bit positions
+        and the window holds 32 times the window size, so it slides
+        31 times less often, and only the base of the positions
+        moves. The chains are rebased once every two gigabytes of
+        input. This pays off with small windows, where the hash
+        table is large compared to the window: with a `windowBits`
+        of 9 and the default memory level, levels 1 and 6 are about
+        a fifth faster. With the default window the larger tables
+        make compression a little slower. This takes
+        `(30 << windowBits) + (2 << (memLevel + 7)) +
+        (2 << windowBits)` bytes more than the default.
+
+        Only the hash chains of levels 1 to 9 use 32 bit positions;
+        the setting is ignored for other levels, for
+        `Strategy::quick`, for the medium compressor and for the
+        binary tree, and @ref params fails with
+        `error::stream_error` if it would switch a stream using
+        them to one of those. A block whose input has left a zlib
+        sized window, but not the longer one, can be stored where
+        zlib would code it, so the output of incompressible data
+        with a window smaller than the blocks differs from zlib.
+        The default is off, and the setting is kept across calls
+        to @ref reset.
+
+        @note Any unprocessed input or pending output from
+        previous calls are discarded.
+    */
+    void
+    long_positions(bool on)
+    {
+        doLongPositions(on);
+    }
+
+    /** Return the statistics collected since the last reset.
+
+        The counters describe the work done by the match finder,
+        and can be compared across compression levels and hash
+        functions on the same input.
+    */
+    deflate_stats const&
+    stats() const noexcept
+    {
+        return stats_;
     }
 
     /** Compress input and write output.
@@ -270,7 +479,10 @@ public:
         `upper_bound` (see below). Then `write` is guaranteed to return
         the `error::end_of_stream` error. If not enough output space
         is provided, deflate will not return `error::end_of_stream`,
-        and it must be called again as described above.
+        and it must be called again as described above. Input given
+        in a single step is compressed in place, without being copied
+        to the stream's window, and the buffer need not be kept once
+        `write` returns.
 
         `write` returns no error if some progress has been made (more
         input processed or more output produced), `error::end_of_stream`
@@ -321,6 +533,62 @@ public:
         doParams(zs, level, strategy, ec);
     }
 
+    /** Set a preset dictionary.
+
+        This function initializes the compression history with
+        the given bytes, so that the data compressed next may
+        refer to strings in it. The decompressor must be given
+        the same dictionary. Dictionaries help most with short
+        inputs which resemble each other, where the compressor
+        would otherwise start without history for each one.
+
+        Only the last `1 << windowBits` bytes of the dictionary
+        are used. The function must be called after a reset,
+        before the first call of @ref write, or for a raw stream
+        also after a flush which consumed all of the input. A
+        zlib stream records the adler32 of the dictionary in its
+        header, as `deflateSetDictionary` does, so it only takes
+        one before the first write.
+
+        @param data A pointer to the dictionary bytes.
+
+        @param size The number of dictionary bytes.
+
+        @param ec `error::stream_error` if the stream has input
+        which is not compressed yet, writes the gzip format,
+        which has no preset dictionary, or writes the zlib
+        format and has already been written to.
+    */
+    void
+    set_dictionary(
+        void const* data,
+        std::size_t size,
+        error_code& ec)
+    {
+        doDictionary(static_cast<Byte const*>(data), size, ec);
+    }
+
+    /** Set a prepared preset dictionary.
+
+        This has the same effect as setting the bytes of the
+        dictionary with the overload above. When the dictionary
+        was prepared for the parameters of this stream, the
+        hashed window is copied instead of being computed again.
+
+        @param dict The dictionary. The stream does not keep a
+        reference to it.
+
+        @param ec `error::stream_error` if the stream has input
+        which is not compressed yet, or writes the gzip format.
+    */
+    void
+    set_dictionary(
+        prepared_dictionary const& dict,
+        error_code& ec)
+    {
+        doDictionary(dict, ec);
+    }
+
     /** Return bits pending in the output.
 
         This function returns the number of bytes and bits of output
@@ -38,6 +38,8 @@
 #define BOOST_DEFLATE_DETAIL_ADLER_HPP
 
 #include <boost/deflate/config.hpp>
+#include <cstddef>
+#include <cstdint>
 
 namespace boost {
 namespace deflate {
@@ -46,6 +48,19 @@ namespace detail {
 BOOST_DEFLATE_DECL
 unsigned adler32(const unsigned char* buf, unsigned len, unsigned adler = 0U) noexcept;
 
+/* Copies `len` bytes from `src` to `dst` and returns the Adler-32 checksum
+   of them with `adler` as the initial value, reading the bytes once. The
+   buffers must not overlap. */
+BOOST_DEFLATE_DECL
+unsigned adler32_copy(unsigned char* dst, const unsigned char* src,
+                      std::size_t len, unsigned adler) noexcept;
+
+/* Returns the Adler-32 checksum of two sequences concatenated, given the
+   checksum `adler1` of the first, and the checksum `adler2` and length
+   `len2` of the second. */
+BOOST_DEFLATE_DECL
+unsigned adler32_combine(unsigned adler1, unsigned adler2, std::uint64_t len2) noexcept;
+
 } // detail
 } // deflate
 } // boost
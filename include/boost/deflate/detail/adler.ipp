@@ -39,66 +39,171 @@
 
 #include <boost/deflate/detail/adler.hpp>
 
+#ifdef BOOST_DEFLATE_USE_SSE2
+# include <emmintrin.h>
+#endif
+
 namespace boost {
 namespace deflate {
 namespace detail {
 
-// zlib's Adler-32 implementation
-unsigned adler32(const unsigned char* buf, unsigned len, unsigned adler) noexcept {
-  constexpr auto base = 65521U; // largest prime smaller than 65536
-  constexpr auto nmax = 5552; // max(n) such that
-                              // 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+constexpr unsigned adler_base = 65521U; // largest prime smaller than 65536
+constexpr unsigned adler_nmax = 5552;   // max(n) such that
+                                        // 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1
+
+/* The kernels below return the Adler-32 checksum of the `len` bytes at
+   `src`, and when `Copy` is true also store them at `dst` as they are
+   summed, so the copy and the checksum take a single pass. */
 
+// zlib's Adler-32 implementation
+template<bool Copy>
+inline
+unsigned
+adler32_scalar(unsigned char* dst, const unsigned char* src,
+               std::size_t len, unsigned adler) noexcept {
   // split into component sum
   unsigned long sum = (adler >> 16u) & 0xffff;
-  adler &= 0xffff;
-
-  if (buf == nullptr)
-      return 1U;
+  unsigned long a = adler & 0xffff;
 
-  if (len < 16) {
-      while (len--) {
-         adler += *buf++;
-         sum += adler;
+  while (len) {
+      auto n = len < adler_nmax ? len : adler_nmax;
+      len -= n;
+      while (n >= 16) {
+          n -= 16;
+          for(int i = 0; i < 16; ++i) {
+              if(Copy)
+                  dst[i] = src[i];
+              a += src[i];
+              sum += a;
+          }
+          src += 16;
+          if(Copy)
+              dst += 16;
       }
-      if (adler >= base)
-         adler -= base;
-      sum %= base;
-      return adler | (sum << 16);
+      while (n--) {
+          if(Copy)
+              *dst++ = *src;
+          a += *src++;
+          sum += a;
+      }
+      a %= adler_base;
+      sum %= adler_base;
   }
+  return static_cast<unsigned>(a | (sum << 16));
+}
 
-  while (len >= nmax) {
-      len -= nmax;
-      auto n = nmax / 16;
+#ifdef BOOST_DEFLATE_USE_SSE2
+inline
+std::uint32_t
+adler32_hsum(__m128i v) noexcept {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return static_cast<std::uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+/* Thirty-two bytes at a time. The byte sums come from a sum of absolute
+   differences against zero, and the position weighted sums from multiply
+   and add of the bytes widened to sixteen bits. */
+template<bool Copy>
+inline
+unsigned
+adler32_sse2(unsigned char* dst, const unsigned char* src,
+             std::size_t len, unsigned adler) noexcept {
+  std::uint32_t s1 = adler & 0xffff;
+  std::uint32_t s2 = (adler >> 16) & 0xffff;
+
+  auto blocks = len / 32;
+  len -= blocks * 32;
+
+  auto const zero = _mm_setzero_si128();
+  auto const w0 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25);
+  auto const w1 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+  auto const w2 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+  auto const w3 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+
+  while (blocks) {
+      auto n = blocks < adler_nmax / 32 ? blocks : adler_nmax / 32;
+      blocks -= n;
+
+      // s1 is added to s2 once per byte of the chunk
+      auto v_ps = _mm_cvtsi32_si128(static_cast<int>(s1 * n));
+      auto v_s2 = _mm_cvtsi32_si128(static_cast<int>(s2));
+      auto v_s1 = zero;
       do {
-          for(int i = 0; i < 16; ++i) {
-              adler += (buf)[i];
-              sum += adler;
+          auto const a = _mm_loadu_si128(
+              reinterpret_cast<__m128i const*>(src));
+          auto const b = _mm_loadu_si128(
+              reinterpret_cast<__m128i const*>(src + 16));
+          src += 32;
+          if(Copy) {
+              _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), a);
+              _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+              dst += 32;
           }
-          buf += 16;
+          v_ps = _mm_add_epi32(v_ps, v_s1);
+          v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(a, zero));
+          v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b, zero));
+          v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+              _mm_unpacklo_epi8(a, zero), w0));
+          v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+              _mm_unpackhi_epi8(a, zero), w1));
+          v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+              _mm_unpacklo_epi8(b, zero), w2));
+          v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+              _mm_unpackhi_epi8(b, zero), w3));
       } while (--n);
-      adler %= base;
-      sum %= base;
-  }
+      v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
 
-  if (len) {
-      while (len >= 16) {
-          len -= 16;
-          for(int i = 0; i < 16; ++i) {
-              adler += (buf)[i];
-              sum += adler;
-          }
-          buf += 16;
-      }
-      while (len--) {
-          adler += *buf++;
-          sum += adler;
-      }
-      adler %= base;
-      sum %= base;
+      s1 += adler32_hsum(v_s1);
+      s2 = adler32_hsum(v_s2);
+      s1 %= adler_base;
+      s2 %= adler_base;
   }
+  return adler32_scalar<Copy>(dst, src, len, s1 | (s2 << 16));
+}
+#endif
+
+template<bool Copy>
+inline
+unsigned
+adler32_kernel(unsigned char* dst, const unsigned char* src,
+               std::size_t len, unsigned adler) noexcept {
+#ifdef BOOST_DEFLATE_USE_SSE2
+  return adler32_sse2<Copy>(dst, src, len, adler);
+#else
+  return adler32_scalar<Copy>(dst, src, len, adler);
+#endif
+}
+
+unsigned adler32(const unsigned char* buf, unsigned len, unsigned adler) noexcept {
+  if (buf == nullptr)
+      return 1U;
+  return adler32_kernel<false>(nullptr, buf, len, adler);
+}
+
+unsigned adler32_copy(unsigned char* dst, const unsigned char* src,
+                      std::size_t len, unsigned adler) noexcept {
+  return adler32_kernel<true>(dst, src, len, adler);
+}
 
-  return adler | (sum << 16);
+// zlib's adler32_combine
+unsigned adler32_combine(unsigned adler1, unsigned adler2, std::uint64_t len2) noexcept {
+  constexpr auto base = adler_base;
+
+  auto const rem = static_cast<unsigned>(len2 % base);
+  unsigned long sum1 = adler1 & 0xffff;
+  unsigned long sum2 = (rem * sum1) % base;
+  sum1 += (adler2 & 0xffff) + base - 1;
+  sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
+  if (sum1 >= base)
+      sum1 -= base;
+  if (sum1 >= base)
+      sum1 -= base;
+  if (sum2 >= (static_cast<unsigned long>(base) << 1))
+      sum2 -= (static_cast<unsigned long>(base) << 1);
+  if (sum2 >= base)
+      sum2 -= base;
+  return static_cast<unsigned>(sum1 | (sum2 << 16));
 }
 
 } // detail
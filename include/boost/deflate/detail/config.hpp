@@ -79,6 +79,60 @@
 # endif
 #endif
 
+#if defined(BOOST_DEFLATE_USE_SSE2) && !defined(BOOST_DEFLATE_NO_AVX2)
+# if defined(__AVX2__)
+#  define BOOST_DEFLATE_USE_AVX2
+# endif
+#endif
+
+/*  Without AVX2 in the build, GCC and Clang can still compile AVX2
+    kernels for use when the processor supports them.
+*/
+#if defined(BOOST_DEFLATE_USE_SSE2) && !defined(BOOST_DEFLATE_USE_AVX2) && \
+    !defined(BOOST_DEFLATE_NO_AVX2)
+# if (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__x86_64__) || defined(__i386__))
+#  define BOOST_DEFLATE_DETECT_AVX2
+# endif
+#endif
+
+#ifdef BOOST_DEFLATE_DETECT_AVX2
+# define BOOST_DEFLATE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+# define BOOST_DEFLATE_TARGET_AVX2
+#endif
+
+/*  The folding CRC-32 kernels need the carry-less multiply instruction,
+    which is detected at run time unless it is enabled in the build.
+*/
+#if defined(BOOST_DEFLATE_USE_SSE2) && !defined(BOOST_DEFLATE_NO_PCLMUL)
+# if defined(__PCLMUL__)
+#  define BOOST_DEFLATE_USE_PCLMUL
+# elif (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__x86_64__) || defined(__i386__))
+#  define BOOST_DEFLATE_DETECT_PCLMUL
+# endif
+#endif
+
+#ifdef BOOST_DEFLATE_DETECT_PCLMUL
+# define BOOST_DEFLATE_TARGET_PCLMUL __attribute__((target("pclmul")))
+#else
+# define BOOST_DEFLATE_TARGET_PCLMUL
+#endif
+
+#if defined(BOOST_DEFLATE_USE_SSE2) && !defined(BOOST_DEFLATE_NO_SSE42)
+# if defined(__SSE4_2__) || defined(__AVX__)
+#  define BOOST_DEFLATE_USE_SSE42
+# endif
+#endif
+
+// detect byte order, all supported MSVC targets are little endian
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+# if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define BOOST_DEFLATE_BIG_ENDIAN
+# endif
+#endif
+
 #ifndef BOOST_DEFLATE_STANDALONE
 # if defined(GENERATING_DOCUMENTATION)
 #  define BOOST_DEFLATE_DECL
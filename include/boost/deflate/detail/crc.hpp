@@ -14,6 +14,7 @@
 
 #include <boost/deflate/config.hpp>
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace boost {
@@ -27,6 +28,23 @@ unsigned crc32(const unsigned char* buf,
                size_t size,
                std::uint32_t crc = 0) noexcept;
 
+/* Copies `size` bytes from `src` to `dst` and returns the CRC32 checksum of
+   them with `crc` as the initial value, reading the bytes once. The buffers
+   must not overlap. */
+BOOST_DEFLATE_DECL
+unsigned crc32_copy(unsigned char* dst,
+                    const unsigned char* src,
+                    size_t size,
+                    std::uint32_t crc) noexcept;
+
+/* Returns the CRC32 checksum of two sequences concatenated, given the
+   checksum `crc1` of the first, and the checksum `crc2` and length `len2`
+   of the second. */
+BOOST_DEFLATE_DECL
+unsigned crc32_combine(std::uint32_t crc1,
+                       std::uint32_t crc2,
+                       std::uint64_t len2) noexcept;
+
 /* Applies CRC32 on the `I` lower bytes of `v` using `crc` as the crc value and
    output */
 template <class T, int I = sizeof(T)>
@@ -13,6 +13,11 @@
 
 #include <boost/deflate/detail/crc.hpp>
 
+#if defined(BOOST_DEFLATE_USE_PCLMUL) || defined(BOOST_DEFLATE_DETECT_PCLMUL)
+# include <emmintrin.h>
+# include <wmmintrin.h>
+#endif
+
 namespace boost {
 namespace deflate {
 namespace detail {
@@ -63,13 +68,218 @@ constexpr const unsigned crc32_tab[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/* The kernels below update the inverted CRC `crc` with the `size` bytes at
+   `src`, and when `Copy` is true also store them at `dst`, so the copy and
+   the checksum take a single pass. */
+
+// One byte at a time with the table.
+template<bool Copy>
+inline
+std::uint32_t
+crc32_scalar(unsigned char* dst,
+             const unsigned char* src,
+             size_t size,
+             std::uint32_t crc) noexcept {
+  while (size--) {
+     if(Copy)
+        *dst++ = *src;
+     crc = crc32_tab[(crc ^ *src++) & 0xFFU] ^ (crc >> 8U);
+  }
+  return crc;
+}
+
+#if defined(BOOST_DEFLATE_USE_PCLMUL) || defined(BOOST_DEFLATE_DETECT_PCLMUL)
+// Multiplies both halves of `x` by the constants in `k` and adds `y`.
+BOOST_DEFLATE_TARGET_PCLMUL
+inline
+__m128i
+crc32_fold(__m128i x, __m128i k, __m128i y) noexcept {
+  return _mm_xor_si128(_mm_xor_si128(
+      _mm_clmulepi64_si128(x, k, 0x00),
+      _mm_clmulepi64_si128(x, k, 0x11)), y);
+}
+
+/* Sixty-four bytes at a time, folding four 128-bit lanes with carry-less
+   multiplies and reducing them to 32 bits at the end, as described in
+   "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+   Instruction" by Gopal et al. `size` is at least 64 and a multiple
+   of 16. The constants are those of the reflected CRC-32 polynomial.
+*/
+template<bool Copy>
+BOOST_DEFLATE_TARGET_PCLMUL
+inline
+std::uint32_t
+crc32_pclmul(unsigned char* dst,
+             const unsigned char* src,
+             size_t size,
+             std::uint32_t crc) noexcept {
+  auto const load = [&](std::size_t i) {
+    auto const v = _mm_loadu_si128(
+        reinterpret_cast<__m128i const*>(src + i));
+    if(Copy)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    return v;
+  };
+  auto x1 = _mm_xor_si128(load(0x00),
+      _mm_cvtsi32_si128(static_cast<int>(crc)));
+  auto x2 = load(0x10);
+  auto x3 = load(0x20);
+  auto x4 = load(0x30);
+  src += 64;
+  if(Copy)
+      dst += 64;
+  size -= 64;
+
+  auto k = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  while (size >= 64) {
+      x1 = crc32_fold(x1, k, load(0x00));
+      x2 = crc32_fold(x2, k, load(0x10));
+      x3 = crc32_fold(x3, k, load(0x20));
+      x4 = crc32_fold(x4, k, load(0x30));
+      src += 64;
+      if(Copy)
+          dst += 64;
+      size -= 64;
+  }
+
+  // fold into 128 bits
+  k = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  x1 = crc32_fold(x1, k, x2);
+  x1 = crc32_fold(x1, k, x3);
+  x1 = crc32_fold(x1, k, x4);
+  while (size >= 16) {
+      x1 = crc32_fold(x1, k, load(0));
+      src += 16;
+      if(Copy)
+          dst += 16;
+      size -= 16;
+  }
+
+  // fold 128 bits to 64 bits
+  auto const mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  k = _mm_set_epi64x(0, 0x0163cd6124);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  k = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return static_cast<std::uint32_t>(
+      _mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+}
+
+inline
+bool
+crc32_has_pclmul() noexcept {
+#ifdef BOOST_DEFLATE_USE_PCLMUL
+  return true;
+#else
+  static bool const has = (__builtin_cpu_init(),
+      __builtin_cpu_supports("pclmul") != 0);
+  return has;
+#endif
+}
+#endif
+
+template<bool Copy>
+inline
+unsigned
+crc32_kernel(unsigned char* dst,
+             const unsigned char* src,
+             size_t size,
+             std::uint32_t crc) noexcept {
+  crc ^= 0xffffffffU;
+#if defined(BOOST_DEFLATE_USE_PCLMUL) || defined(BOOST_DEFLATE_DETECT_PCLMUL)
+  if (size >= 64 && crc32_has_pclmul()) {
+      auto const n = size & ~size_t{15};
+      crc = crc32_pclmul<Copy>(dst, src, n, crc);
+      src += n;
+      if(Copy)
+          dst += n;
+      size -= n;
+  }
+#endif
+  return crc32_scalar<Copy>(dst, src, size, crc) ^ 0xffffffffU;
+}
+
 unsigned crc32(const unsigned char* buf,
                size_t size,
                unsigned crc) noexcept {
-  crc ^= ~0UL;
-  while (size--)
-     crc = crc32_tab[(crc ^ *buf++) & 0xFFU] ^ (crc >> 8U);
-  return crc ^ ~0UL;
+  return crc32_kernel<false>(nullptr, buf, size, crc);
+}
+
+unsigned crc32_copy(unsigned char* dst,
+                    const unsigned char* src,
+                    size_t size,
+                    std::uint32_t crc) noexcept {
+  return crc32_kernel<true>(dst, src, size, crc);
+}
+
+// Multiplies the 32x32 bit matrix `mat` over GF(2) by the vector `vec`
+inline
+std::uint32_t
+gf2_matrix_times(std::uint32_t const* mat, std::uint32_t vec) noexcept {
+  std::uint32_t sum = 0;
+  while (vec) {
+      if (vec & 1)
+          sum ^= *mat;
+      vec >>= 1;
+      mat++;
+  }
+  return sum;
+}
+
+inline
+void
+gf2_matrix_square(std::uint32_t* square, std::uint32_t const* mat) noexcept {
+  for (int n = 0; n < 32; n++)
+      square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// zlib's crc32_combine, applies len2 zero bytes to crc1 by
+// repeated squaring of the one zero bit operator.
+unsigned crc32_combine(std::uint32_t crc1,
+                       std::uint32_t crc2,
+                       std::uint64_t len2) noexcept {
+  std::uint32_t even[32]; // even-power-of-two zeros operator
+  std::uint32_t odd[32];  // odd-power-of-two zeros operator
+
+  if (len2 == 0)
+      return crc1;
+
+  // put operator for one zero bit in odd
+  odd[0] = 0xedb88320U;
+  std::uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+      odd[n] = row;
+      row <<= 1;
+  }
+
+  // put operator for two zero bits in even, then four in odd
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  // apply len2 zeros to crc1, the first square puts the
+  // operator for one zero byte, eight zero bits, in even
+  do {
+      gf2_matrix_square(even, odd);
+      if (len2 & 1)
+          crc1 = gf2_matrix_times(even, crc1);
+      len2 >>= 1;
+      if (len2 == 0)
+          break;
+      gf2_matrix_square(odd, even);
+      if (len2 & 1)
+          crc1 = gf2_matrix_times(odd, crc1);
+      len2 >>= 1;
+  } while (len2 != 0);
+
+  return crc1 ^ crc2;
 }
 
 } // detail
@@ -40,6 +40,8 @@
 
 #include <boost/deflate/error.hpp>
 #include <boost/deflate/deflate.hpp>
+#include <boost/deflate/prepared_dictionary.hpp>
+#include <boost/deflate/detail/byte_swap.hpp>
 #include <boost/deflate/detail/header_constants.hpp>
 #include <boost/deflate/detail/ranges.hpp>
 #include <boost/assert.hpp>
@@ -52,6 +54,11 @@
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
+
+#ifdef BOOST_DEFLATE_USE_SSE42
+# include <nmmintrin.h>
+#endif
 
 namespace boost {
 namespace deflate {
@@ -122,7 +129,34 @@ protected:
     static std::uint16_t constexpr heap_size = 2 * lcodes + 1;
 
     // size of bit buffer in bi_buf
-    static std::uint8_t constexpr buf_size = 16;
+    static std::uint8_t constexpr buf_size = 64;
+
+    // Shortest match written by Strategy::quick, which hashes four bytes
+    static std::uint8_t constexpr quick_min_match = 4;
+
+    // Symbols tallied between checks for the end of a block
+    static std::uint16_t constexpr split_interval = 512;
+
+    // Input bytes in a block before it may be ended early
+    static std::uint16_t constexpr split_min_length = 10000;
+
+    // Symbols in a block up to which its type is first estimated
+    static std::uint16_t constexpr small_block = 2048;
+
+    // Large blocks hold 1 << large_block_shift times as many symbols
+    static std::uint8_t constexpr large_block_shift = 4;
+
+    // With long positions the window holds 1 << long_window_shift windows
+    static std::uint8_t constexpr long_window_shift = 5;
+
+    // Base of long positions from which the hash chains are rebased
+    static std::uint32_t constexpr long_rebase = 0x80000000;
+
+    // Input bytes compressed by Strategy::adaptive between its choices
+    static std::uint32_t constexpr adaptive_chunk = 32768;
+
+    // Bytes at each end of a chunk from which its engine is chosen
+    static std::uint16_t constexpr adaptive_sample = 4096;
 
     // Matches of length 3 are discarded if their distance exceeds ktoo_far
     static std::size_t constexpr ktoo_far = 4096;
@@ -132,6 +166,12 @@ protected:
     */
     static std::size_t constexpr kmin_lookahead = max_match + min_match + 1;
 
+    /*  Bytes of the caller's buffer left unread while the window points
+        into it. The match finders read up to max_match bytes past the
+        input, which must stay inside the buffer.
+    */
+    static std::size_t constexpr borrow_margin = 2 * kmin_lookahead;
+
     /*  Number of bytes after end of data in window to initialize in order
         to avoid memory checker errors from longest match routines
     */
@@ -140,7 +180,7 @@ protected:
     // Describes a single value and its code string.
     struct ct_data
     {
-        std::uint16_t fc; // frequency count or bit string
+        std::uint32_t fc; // frequency count or bit string
         std::uint16_t dl; // parent node in tree or length of bit string
 
         bool
@@ -159,6 +199,18 @@ protected:
         std::uint8_t        max_length; // max bit length for the codes
     };
 
+    /*  A length or distance code followed by its extra bits, sent
+        together. The extra bits of a match length are in bits. Those
+        of a distance d - 1 are added as (d - 1) << shift, the base of
+        the distance code having been taken off bits, modulo 2^32.
+    */
+    struct code_extra
+    {
+        std::uint32_t bits;
+        std::uint8_t len;   // code and extra bits
+        std::uint8_t shift; // code bits
+    };
+
     struct lut_type
     {
         // Number of extra bits for each length code
@@ -198,6 +250,13 @@ protected:
 
         std::uint16_t base_dist[dcodes];
 
+        // Fewest bits which can describe a run of zero code lengths
+        std::uint8_t zero_run_bits[lcodes + 1];
+
+        // The static codes of each match length - min_match and distance code
+        code_extra static_lengths[max_match - min_match + 1];
+        code_extra static_dists[dcodes];
+
         static_desc l_desc = {
             ltree, extra_lbits, literals+1, lcodes, max_bits
         };
@@ -262,6 +321,7 @@ protected:
     Byte* pending_out_;             // next pending byte to output to the stream
     uInt pending_;                  // nb of bytes in the pending buffer
     wrap wrap_;                     // stream wrapper
+    std::uint32_t dict_id_;         // adler32 of the preset dictionary
     gz_header* gzhead_;             // pointer to gzip header
     std::uint32_t gzindex_;         // where in extra, name, or comment (gzip)
     boost::optional<Flush>
@@ -277,7 +337,10 @@ protected:
         wSize-max_match bytes, but this ensures that IO is always
         performed with a length multiple of the block size. Also, it limits
         the window size to 64K.
-        To do: use the user input buffer as sliding window.
+        When all of the input is given to one write which finishes the
+        stream, the window points into the caller's buffer instead, see
+        borrowed(). Nothing is written through it then: the input is not
+        copied, and the window slides by moving the pointer.
     */
     Byte *window_ = nullptr;
 
@@ -289,11 +352,27 @@ protected:
     /*  Link to older string with same hash index. To limit the size of this
         array to 64K, this link is maintained only for the last 32K strings.
         An index in this array is thus a window index modulo 32K.
+        With the binary tree match finder each string has two links
+        instead, at 2*index and 2*index+1, to the roots of the subtrees
+        of older strings which sort before and after it.
+        With long positions the links and heads are 32 bit positions,
+        see head() and prev().
     */
     std::uint16_t* prev_;
 
     std::uint16_t* head_;           // Heads of the hash chains or 0
 
+    /*  Long positions: the hash chains hold 32 bit positions counted
+        from base_, the position of window index 0, instead of window
+        indices. The window is 1 << long_window_shift times the window
+        size, and when it slides only base_ moves. The chains are only
+        rebased when base_ reaches long_rebase. Only the hash chains of
+        levels 1 to 9 use long positions, see init().
+    */
+    bool long_ = false;             // long positions requested
+    bool wide_ = false;             // long positions in use, set by init()
+    std::uint32_t base_;
+
     uInt  ins_h_;                   // hash index of string to be inserted
     uInt  hash_size_;               // number of elements in hash table
     uInt  hash_bits_;               // log2(hash_size)
@@ -306,6 +385,26 @@ protected:
     */
     uInt hash_shift_;
 
+    Hash hash_ = Hash::rolling;     // hash function of the match finder
+    MatchFinder finder_ =
+        MatchFinder::automatic;     // match finder requested by the caller
+    bool tree_ = false;             // binary tree in use, set by init()
+    bool medium_ = false;           // medium compressor for levels 4 to 6
+
+    /*  Window index one past the last byte of input, which bounds
+        the comparisons made when a string is inserted in the tree.
+        Unlike strstart+lookahead it stays valid while the strings
+        of a match are inserted.
+    */
+    uInt input_end_;
+    uInt bt_len_;                   // longest match found by the last insert
+    IPos bt_start_;                 // start of that match
+
+    /*  Smallest nice_match the tree was built with. The strings of
+        a subtree are only known to be sorted as far as that length.
+    */
+    uInt bt_nice_;
+
     /*  Window position at the beginning of the current output block.
         Gets negative when the window is moved backwards.
     */
@@ -339,12 +438,18 @@ protected:
     */
     uInt max_lazy_match_;
 
-    int level_;                     // compression level (1..9)
+    int level_;                     // compression level (0..12)
     Strategy strategy_;             // favor or force Huffman coding
 
     // Use a faster search when the previous match is longer than this
     uInt good_match_;
 
+    /*  Shortest match sent by deflate_fast, min_match or min_match+1.
+        With min_match+1 the rolling hash is replaced by the
+        multiplicative hash of four bytes, see hash_string.
+    */
+    uInt min_length_;
+
     int nice_match_;                // Stop searching when current match exceeds this
 
     ct_data dyn_ltree_[
@@ -375,8 +480,6 @@ protected:
     // Depth of each subtree used as tie breaker for trees of equal frequency
     std::uint8_t depth_[2 * lcodes + 1];
 
-    std::uint8_t *l_buf_;           // buffer for literals or lengths
-
     /*  Size of match buffer for literals/lengths.
         There are 4 reasons for limiting lit_bufsize to 64K:
           - frequencies can be kept in 16 bit counters
@@ -394,31 +497,44 @@ protected:
             fast adaptation but have of course the overhead of transmitting
             trees more frequently.
           - I can't count above 4
+        The frequencies are kept in 32 bit counters, and with large blocks
+        the buffer holds sixteen times as many symbols apart from
+        pending_buf_, trading memory for fewer, larger blocks.
     */
     uInt lit_bufsize_;
-    uInt last_lit_;                 // running index in l_buf_
+    uInt lit_bits_;                 // log2(lit_bufsize) without large blocks
+    bool large_ = false;            // symbols are kept apart from pending_buf_
 
-    /*  Buffer for distances. To simplify the code, d_buf_ and l_buf_
-        have the same number of elements. To use different lengths, an
-        extra flag array would be necessary.
+    /*  Buffer for the symbols of the current block, three bytes each:
+        the distance of a match, low byte first, or 0 for a literal,
+        then the match length - min_match or the literal. Both are
+        read and written together, in the order they are coded.
     */
-    std::uint16_t* d_buf_;
+    std::uint8_t* sym_buf_;
+    uInt sym_next_;                 // running index in sym_buf_
+    uInt sym_end_;                  // symbol table full when sym_next_ reaches this
 
     std::uint32_t opt_len_;         // bit length of current block with optimal trees
     std::uint32_t static_len_;      // bit length of current block with static trees
     uInt matches_;                  // number of string matches in current block
     uInt insert_;                   // bytes at end of window left to insert
+    std::uint8_t stale_hash_;       // window slides f_stored owes the hash
 
     /*  Output buffer.
         Bits are inserted starting at the bottom (least significant bits).
+        When all 64 bits are used they are written to pending_buf_ with
+        a single store, see send_bits.
      */
-    std::uint16_t bi_buf_;
+    std::uint64_t bi_buf_;
 
     /*  Number of valid bits in bi_buf._  All bits above the last valid
-        bit are always zero.
+        bit are always zero. This is always less than buf_size.
     */
     int bi_valid_;
 
+    // Static block of Strategy::quick: 0 closed, 1 open, 2 open and last
+    int block_open_;
+
     /*  High water mark offset in window for initialized bytes -- bytes
         above this are set to zero in order to avoid memory check warnings
         when longest match routines access bytes past the input.  This is
@@ -426,6 +542,95 @@ protected:
     */
     std::uint32_t high_water_;
 
+    deflate_stats stats_;           // counters, cleared on reset
+
+    /*  Statistics of the current block for ending it where the data
+        changes. Each symbol is counted in one of a few coarse classes:
+        literals by their top bits and parity, matches by their length.
+        When enough new symbols are counted, their distribution is
+        compared with that of the symbols before them in the block.
+    */
+    struct split_state
+    {
+        static int constexpr classes = 10;
+
+        std::uint32_t seen[classes];    // symbols checked before
+        std::uint32_t fresh[classes];   // symbols since the last check
+        std::uint32_t nseen;
+        std::uint32_t nfresh;
+    };
+
+    bool split_ = false;            // end blocks where the data changes
+    split_state split_stats_;
+
+    /*  The trees of the last block sent with fresh dynamic trees,
+        with their description as it was sent. A later block whose
+        symbols they still code well sends them again, which saves
+        building the trees and their description.
+    */
+    struct tree_cache
+    {
+        // Bytes for the longest description, with room for a last word
+        static std::size_t constexpr header_size = 640;
+
+        ct_data ltree[lcodes];          // codes and lengths
+        ct_data dtree[dcodes];
+        Byte header[header_size];       // the description, as sent
+        std::uint32_t header_bits;
+        double ratio;                   // code bits per bit of entropy
+        bool valid = false;
+
+        double entropy;                 // of the current block
+        std::uint32_t extra_bits;       // of the current block
+    };
+
+    bool reuse_ = false;            // send the trees of the last block again
+    std::unique_ptr<tree_cache> trees_;
+
+    /*  The engine chosen by Strategy::adaptive for the current chunk
+        of input, null before the first choice, and the input bytes
+        left in the chunk. Blocks are stored when the engine is
+        deflate_stored, whatever the level. With skip_ the other
+        strategies choose between deflate_stored and their level.
+    */
+    bool skip_ = false;             // store incompressible chunks
+    compress_func adaptive_func_ = nullptr;
+    std::size_t adaptive_left_ = 0;
+    bool store_ = false;
+
+    /*  State of the optimal parser used by levels 10 and up. The
+        input is parsed in segments; for every position of a segment
+        the candidate matches are collected once, then the cheapest
+        path through them is found repeatedly, each time with symbol
+        costs taken from the statistics of the previous path.
+    */
+    struct optimal_state
+    {
+        struct step
+        {
+            std::uint16_t len;      // 1 for a literal
+            std::uint16_t dist;     // 0 for a literal
+        };
+
+        /*  Matches of increasing length found at each position. For
+            each length the smallest distance is the one of the first
+            match which is at least as long.
+        */
+        std::vector<step> matches;
+        std::vector<std::uint32_t> first;   // first match of each position
+        std::vector<float> cost;            // cost of reaching each position
+        std::vector<step> from;             // last step of that path
+        std::vector<step> path;             // steps of the current parse
+        std::vector<step> best;             // cheapest parse so far
+
+        // Estimated cost in bits of each literal, length and distance code
+        float lit_cost[literals];
+        float len_cost[max_match + 1];
+        float dist_cost[dcodes];
+    };
+
+    std::unique_ptr<optimal_state> opt_;
+
     //--------------------------------------------------------------------------
 
     deflate_stream()
@@ -442,6 +647,102 @@ protected:
         return w_size_ - kmin_lookahead;
     }
 
+    /*  Parameters of a stream which are known at compile time. A
+        negative format and zero window bits stand for the values
+        given to reset. With both dynamic, the hash function and the
+        match finder are chosen at run time too, otherwise they are
+        the rolling hash and the hash chains.
+    */
+    template<int Format, unsigned WindowBits, bool Wide = false>
+    struct params
+    {
+        static constexpr int format = Format;
+        static constexpr unsigned w_bits = WindowBits;
+        static constexpr bool dynamic = Format < 0 && WindowBits == 0;
+        static constexpr bool wide = Wide;
+    };
+
+    using dynamic_params = params<-1, 0>;
+
+    // Dynamic parameters of a stream with long positions
+    using long_params = params<-1, 0, true>;
+
+    // The type of the positions in the hash chains
+    template<class P>
+    using pos_type = typename std::conditional<
+        P::wide, std::uint32_t, std::uint16_t>::type;
+
+    template<class P>
+    pos_type<P>*
+    head() const
+    {
+        return reinterpret_cast<pos_type<P>*>(head_);
+    }
+
+    template<class P>
+    pos_type<P>*
+    prev() const
+    {
+        return reinterpret_cast<pos_type<P>*>(prev_);
+    }
+
+    // The position of window index 0 in the hash chains
+    template<class P>
+    std::uint32_t
+    pos_base() const
+    {
+        return P::wide ? base_ : 0;
+    }
+
+    template<class P>
+    uInt
+    w_size() const
+    {
+        return P::w_bits != 0 ? 1U << P::w_bits : w_size_;
+    }
+
+    template<class P>
+    uInt
+    w_mask() const
+    {
+        return w_size<P>() - 1;
+    }
+
+    template<class P>
+    std::uint32_t
+    window_size() const
+    {
+        return P::w_bits != 0 ? 2U << P::w_bits : window_size_;
+    }
+
+    template<class P>
+    uInt
+    max_dist() const
+    {
+        return w_size<P>() - kmin_lookahead;
+    }
+
+    template<class P>
+    wrap
+    format() const
+    {
+        return P::format < 0 ? wrap_ : static_cast<wrap>(P::format);
+    }
+
+    // Count a search of the match finder which examined links entries
+    void
+    count_search(std::size_t links) noexcept
+    {
+#ifndef BOOST_DEFLATE_NO_MATCH_STATS
+        ++stats_.searches;
+        stats_.chain_links += links;
+        if(stats_.max_chain < links)
+            stats_.max_chain = links;
+#else
+        (void)links;
+#endif
+    }
+
     void
     put_byte(std::uint8_t c)
     {
@@ -465,7 +766,7 @@ protected:
     void
     put_long(std::uint32_t w)
     {
-        put_short(w & 0xff);
+        put_short(w & 0xffff);
         put_short(w >> 16);
     }
 
@@ -473,26 +774,87 @@ protected:
     put_long_msb(std::uint32_t w)
     {
         put_short_msb(w >> 16);
-        put_short_msb(w & 0xff);
+        put_short_msb(w & 0xffff);
+    }
+
+    // Store a whole bit buffer, least significant byte first
+    static
+    void
+    store_bits64(Byte* p, std::uint64_t w)
+    {
+#ifdef BOOST_DEFLATE_BIG_ENDIAN
+        w = bswap(w);
+#endif
+        std::memcpy(p, &w, sizeof(w));
     }
 
+    // Write the whole bit buffer, least significant byte first
+    void
+    put_bits64(std::uint64_t w)
+    {
+        store_bits64(pending_buf_ + pending_, w);
+        pending_ += sizeof(w);
+    }
+
+    /*  The bit buffer and the end of the pending output held in a
+        local, for loops which send many codes. Stores through out may
+        alias any member, keeping the state out of the stream lets it
+        stay in registers. The caller makes sure there is room in the
+        pending buffer.
+    */
+    struct bit_cursor
+    {
+        std::uint64_t buf;
+        int valid;
+        Byte* out;
+
+        // Same as deflate_stream::send_bits
+        void
+        send_bits(int value, int length)
+        {
+            send_bits64(static_cast<unsigned>(value), length);
+        }
+
+        // Send up to 63 bits at once, which must fit in length bits
+        void
+        send_bits64(std::uint64_t v, int length)
+        {
+            buf |= v << valid;
+            valid += length;
+            if(valid >= buf_size)
+            {
+                store_bits64(out, buf);
+                out += sizeof(buf);
+                valid -= buf_size;
+                buf = v >> (length - valid);
+            }
+        }
+
+        void
+        send_code(int value, ct_data const* tree)
+        {
+            send_bits(tree[value].fc, tree[value].dl);
+        }
+    };
+
     /*  Send a value on a given number of bits.
         IN assertion: length <= 16 and value fits in length bits.
     */
     void
     send_bits(int value, int length)
     {
-        if(bi_valid_ > (int)buf_size - length)
+        BOOST_ASSERT(length <= 16 && bi_valid_ < buf_size);
+        auto const v = static_cast<std::uint64_t>(
+            static_cast<unsigned>(value));
+        bi_buf_ |= v << bi_valid_;
+        bi_valid_ += length;
+        if(bi_valid_ >= buf_size)
         {
-            bi_buf_ |= (std::uint16_t)value << bi_valid_;
-            put_short(bi_buf_);
-            bi_buf_ = (std::uint16_t)value >> (buf_size - bi_valid_);
-            bi_valid_ += length - buf_size;
-        }
-        else
-        {
-            bi_buf_ |= (std::uint16_t)(value) << bi_valid_;
-            bi_valid_ += length;
+            put_bits64(bi_buf_);
+            bi_valid_ -= buf_size;
+            // The bits of value which did not fit, shifting by
+            // at most length so this is zero when all of them did.
+            bi_buf_ = v >> (length - bi_valid_);
         }
     }
 
@@ -527,12 +889,64 @@ protected:
         h = ((h << hash_shift_) ^ c) & hash_mask_;
     }
 
+    /*  Return the hash of the string at window index str, using
+        the hash function selected for the stream. The rolling hash
+        updates ins_h_ with the last byte of the string, so it has
+        the same requirement as update_hash: calls must be made with
+        consecutive strings. The other hash functions read four
+        bytes and do not depend on previous calls.
+    */
+    uInt
+    hash_string(uInt str)
+    {
+        switch(hash_)
+        {
+        default:
+        case Hash::rolling:
+            if(min_length_ > min_match)
+                return hash_multiplicative(window_ + str);
+            update_hash(ins_h_, window_[str + (min_match - 1)]);
+            return ins_h_;
+
+        case Hash::multiplicative:
+            return hash_multiplicative(window_ + str);
+
+        case Hash::crc32c:
+#ifdef BOOST_DEFLATE_USE_SSE42
+            return _mm_crc32_u32(0, read_u32(window_ + str)) & hash_mask_;
+#else
+            return hash_multiplicative(window_ + str);
+#endif
+        }
+    }
+
+    uInt
+    hash_multiplicative(Byte const* p) const
+    {
+        return (read_u32(p) * 2654435761U) >> (32 - hash_bits_);
+    }
+
+    static
+    std::uint32_t
+    read_u32(Byte const* p)
+    {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
     /*  Initialize the hash table (avoiding 64K overflow for 16
         bit systems). prev[] will be initialized on the fly.
     */
     void
     clear_hash()
     {
+        base_ = 0;
+        if(wide_)
+        {
+            std::memset(head_, 0, hash_size_ * sizeof(std::uint32_t));
+            return;
+        }
         head_[hash_size_-1] = 0;
         std::memset((Byte *)head_, 0,
             (unsigned)(hash_size_-1)*sizeof(*head_));
@@ -560,12 +974,49 @@ protected:
             bytes of str are valid (except for the last min_match-1
             bytes of the input file).
     */
+    template<class P>
+    void
+    insert_string(IPos& hash_head)
+    {
+        hash_head = insert_string_at<P>(strstart_);
+    }
+
     void
     insert_string(IPos& hash_head)
     {
-        update_hash(ins_h_, window_[strstart_ + (min_match - 1)]);
-        hash_head = prev_[strstart_ & w_mask_] = head_[ins_h_];
-        head_[ins_h_] = (std::uint16_t)strstart_;
+        hash_head = insert_string_at(strstart_);
+    }
+
+    /*  Insert the string at window index str and return the
+        previous head of its hash chain.
+    */
+    template<class P>
+    IPos
+    insert_string_at(uInt str)
+    {
+        if(P::dynamic && tree_)
+            return bt_insert(str, false);
+        uInt h;
+        if(P::dynamic)
+        {
+            h = hash_string(str);
+        }
+        else
+        {
+            update_hash(ins_h_, window_[str + (min_match - 1)]);
+            h = ins_h_;
+        }
+        IPos const hash_head = prev<P>()[str & w_mask<P>()] = head<P>()[h];
+        head<P>()[h] = static_cast<pos_type<P>>(str + pos_base<P>());
+        return hash_head;
+    }
+
+    IPos
+    insert_string_at(uInt str)
+    {
+        if(wide_)
+            return insert_string_at<long_params>(str);
+        return insert_string_at<dynamic_params>(str);
     }
 
     //--------------------------------------------------------------------------
@@ -614,11 +1065,48 @@ protected:
         case 6: return {  8,  16, 128,  128, &self::deflate_slow};
         case 7: return {  8,  32, 128,  256, &self::deflate_slow};
         case 8: return { 32, 128, 258, 1024, &self::deflate_slow};
+        case 9: return { 32, 258, 258, 4096, &self::deflate_slow};
+        case 10: return { 0,   0, 128, 1024, &self::deflate_optimal}; // optimal parse
+        case 11: return { 0,   0, 258, 4096, &self::deflate_optimal};
         default:
-        case 9: return { 32, 258, 258, 4096, &self::deflate_slow};    // max compression
+        case 12: return { 0,   0, 258, 8192, &self::deflate_optimal}; // max compression
         }
     }
 
+    // Number of times the optimal parser refines its cost model
+    static
+    int
+    optimal_iterations(int level)
+    {
+        return level <= 10 ? 2 : level == 11 ? 5 : 15;
+    }
+
+    // The compress function for a level
+    compress_func
+    level_func(int level) const
+    {
+        if(medium_ && level >= 4 && level <= 6)
+            return &self::deflate_medium;
+        return get_config(level).func;
+    }
+
+    // Whether the match finder is the binary tree at a level
+    static
+    bool
+    uses_tree(MatchFinder finder, int level)
+    {
+        return finder == MatchFinder::binary_tree ||
+            (finder == MatchFinder::automatic &&
+                level >= optimal_size);
+    }
+
+    // Whether the window points into the caller's buffer
+    bool
+    borrowed() const
+    {
+        return window_ != reinterpret_cast<Byte const*>(buf_.get());
+    }
+
     void
     maybe_init()
     {
@@ -636,6 +1124,16 @@ protected:
     void
     gen_codes(ct_data *tree, int max_code, std::uint16_t *bl_count);
 
+    BOOST_DEFLATE_DECL
+    static
+    void
+    pack_codes(
+        lut_type const& lut,
+        ct_data const* ltree,
+        ct_data const* dtree,
+        code_extra* lengths,
+        code_extra* dists);
+
     BOOST_DEFLATE_DECL
     static
     lut_type const&
@@ -645,10 +1143,19 @@ protected:
     BOOST_DEFLATE_DECL void doReset             ();
     BOOST_DEFLATE_DECL void doClear             ();
     BOOST_DEFLATE_DECL std::size_t doUpperBound (std::size_t sourceLen) const;
-    BOOST_DEFLATE_DECL void doTune              (int good_length, int max_lazy, int nice_length, int max_chain);
+    BOOST_DEFLATE_DECL void doTune              (int good_length, int max_lazy, int nice_length, int max_chain, int min_length);
+    BOOST_DEFLATE_DECL void doHash              (Hash hash);
+    BOOST_DEFLATE_DECL void doMatchFinder       (MatchFinder finder);
+    BOOST_DEFLATE_DECL void doMedium            (bool on);
+    BOOST_DEFLATE_DECL void doBlockSplit        (bool on);
+    BOOST_DEFLATE_DECL void doReuseTrees        (bool on);
+    BOOST_DEFLATE_DECL void doLargeBlocks       (bool on);
+    BOOST_DEFLATE_DECL void doStoreIncompressible(bool on);
+    BOOST_DEFLATE_DECL void doLongPositions(bool on);
     BOOST_DEFLATE_DECL void doParams            (z_params& zs, int level, Strategy strategy, error_code& ec);
-    BOOST_DEFLATE_DECL void doWrite             (z_params& zs, boost::optional<Flush> flush, error_code& ec);
-    BOOST_DEFLATE_DECL void doDictionary        (Byte const* dict, uInt dictLength, error_code& ec);
+    BOOST_DEFLATE_DECL void doWrite             (z_params& zs, boost::optional<Flush> flush, error_code& ec, compress_func engine = nullptr);
+    BOOST_DEFLATE_DECL void doDictionary        (Byte const* dict, std::size_t size, error_code& ec);
+    BOOST_DEFLATE_DECL void doDictionary        (prepared_dictionary const& dict, error_code& ec);
     BOOST_DEFLATE_DECL void doPrime             (int bits, int value, error_code& ec);
     BOOST_DEFLATE_DECL void doPending           (unsigned* value, int* bits);
 
@@ -663,6 +1170,10 @@ protected:
     BOOST_DEFLATE_DECL void send_tree           (ct_data *tree, int max_code);
     BOOST_DEFLATE_DECL int  build_bl_tree       ();
     BOOST_DEFLATE_DECL void send_all_trees      (int lcodes, int dcodes, int blcodes);
+    BOOST_DEFLATE_DECL bool dynamic_loses       (std::uint32_t stored_len, bool stored);
+    BOOST_DEFLATE_DECL bool try_saved_trees     ();
+    BOOST_DEFLATE_DECL void save_trees          (int max_blindex, std::uint32_t code_bits);
+    BOOST_DEFLATE_DECL void send_saved_trees    ();
     BOOST_DEFLATE_DECL void compress_block      (ct_data const* ltree, ct_data const* dtree);
     BOOST_DEFLATE_DECL int  detect_data_type    ();
     BOOST_DEFLATE_DECL void bi_windup           ();
@@ -675,36 +1186,120 @@ protected:
     BOOST_DEFLATE_DECL void tr_stored_block     (char *bu, std::uint32_t stored_len, int last);
     BOOST_DEFLATE_DECL void tr_tally_dist       (std::uint16_t dist, std::uint8_t len, bool& flush);
     BOOST_DEFLATE_DECL void tr_tally_lit        (std::uint8_t c, bool& flush);
+    BOOST_DEFLATE_DECL bool split_check         ();
 
     BOOST_DEFLATE_DECL void tr_flush_block      (z_params& zs, char *buf, std::uint32_t stored_len, int last);
-    BOOST_DEFLATE_DECL void fill_window         (z_params& zs);
+    BOOST_DEFLATE_DECL void borrow_window       (z_params& zs);
+    BOOST_DEFLATE_DECL void own_window          ();
     BOOST_DEFLATE_DECL void flush_pending       (z_params& zs);
     BOOST_DEFLATE_DECL void flush_block         (z_params& zs, bool last);
-    BOOST_DEFLATE_DECL int  read_buf            (z_params& zs, Byte *buf, unsigned size);
-    BOOST_DEFLATE_DECL uInt longest_match       (IPos cur_match);
+    BOOST_DEFLATE_DECL uInt find_matches        (uInt pos, IPos cur_match, uInt avail);
+    BOOST_DEFLATE_DECL IPos bt_insert           (uInt pos, bool collect);
+    BOOST_DEFLATE_DECL void set_fixed_costs     ();
+    BOOST_DEFLATE_DECL float set_costs          (std::uint32_t const* lfreq, std::uint32_t const* dfreq);
+    BOOST_DEFLATE_DECL void optimal_parse       (uInt size);
 
-    BOOST_DEFLATE_DECL block_state f_stored     (z_params& zs, Flush flush);
-    BOOST_DEFLATE_DECL block_state f_fast       (z_params& zs, Flush flush);
-    BOOST_DEFLATE_DECL block_state f_slow       (z_params& zs, Flush flush);
     BOOST_DEFLATE_DECL block_state f_rle        (z_params& zs, Flush flush);
     BOOST_DEFLATE_DECL block_state f_huff       (z_params& zs, Flush flush);
+    BOOST_DEFLATE_DECL block_state f_medium     (z_params& zs, Flush flush);
+    BOOST_DEFLATE_DECL uInt medium_match        (IPos hash_head);
+    BOOST_DEFLATE_DECL void medium_insert       (uInt str, uInt len, uInt avail);
+    BOOST_DEFLATE_DECL block_state f_optimal    (z_params& zs, Flush flush);
+    BOOST_DEFLATE_DECL block_state f_quick      (z_params& zs, Flush flush);
+    BOOST_DEFLATE_DECL block_state f_adaptive   (z_params& zs, Flush flush);
+    BOOST_DEFLATE_DECL compress_func adaptive_choice(Byte const* p, std::size_t n) const;
+    BOOST_DEFLATE_DECL void catch_up_hash       ();
+    BOOST_DEFLATE_DECL void slide_positions     (uInt slide);
+    BOOST_DEFLATE_DECL bool keeps_positions     (int level, Strategy strategy) const;
+    BOOST_DEFLATE_DECL void quick_start_block   (bool last);
+    BOOST_DEFLATE_DECL bool quick_end_block     (z_params& zs, bool last);
+
+    /*  The functions below are templates on the parameters known at
+        compile time, see params. They are defined in impl/ so that
+        streams with static parameters can instantiate them.
+    */
+    template<class P> void fill_window          (z_params& zs);
+    template<class P> int  read_buf             (z_params& zs, Byte *buf, unsigned size);
+    template<class P> uInt longest_match        (IPos cur_match);
+    template<class P> block_state f_stored      (z_params& zs, Flush flush);
+    template<class P> block_state f_fast        (z_params& zs, Flush flush);
+    template<class P> block_state f_slow        (z_params& zs, Flush flush);
+
+    void
+    fill_window(z_params& zs)
+    {
+        if(wide_)
+            return fill_window<long_params>(zs);
+        fill_window<dynamic_params>(zs);
+    }
+
+    int
+    read_buf(z_params& zs, Byte *buf, unsigned size)
+    {
+        return read_buf<dynamic_params>(zs, buf, size);
+    }
+
+    uInt
+    longest_match(IPos cur_match)
+    {
+        if(wide_)
+            return longest_match<long_params>(cur_match);
+        return longest_match<dynamic_params>(cur_match);
+    }
+
+    // The compress function of an engine fixed at compile time
+    template<class P>
+    static
+    compress_func
+    engine_func(policy::stored)
+    {
+        return &self::f_stored<P>;
+    }
+
+    template<class P>
+    static
+    compress_func
+    engine_func(policy::fast)
+    {
+        return &self::f_fast<P>;
+    }
+
+    template<class P>
+    static
+    compress_func
+    engine_func(policy::lazy)
+    {
+        return &self::f_slow<P>;
+    }
 
     block_state
     deflate_stored(z_params& zs, Flush flush)
     {
-        return f_stored(zs, flush);
+        if(wide_)
+            return f_stored<long_params>(zs, flush);
+        return f_stored<dynamic_params>(zs, flush);
     }
 
     block_state
     deflate_fast(z_params& zs, Flush flush)
     {
-        return f_fast(zs, flush);
+        if(wide_)
+            return f_fast<long_params>(zs, flush);
+        return f_fast<dynamic_params>(zs, flush);
     }
 
     block_state
     deflate_slow(z_params& zs, Flush flush)
     {
-        return f_slow(zs, flush);
+        if(wide_)
+            return f_slow<long_params>(zs, flush);
+        return f_slow<dynamic_params>(zs, flush);
+    }
+
+    block_state
+    deflate_medium(z_params& zs, Flush flush)
+    {
+        return f_medium(zs, flush);
     }
 
     block_state
@@ -718,6 +1313,24 @@ protected:
     {
         return f_huff(zs, flush);
     }
+
+    block_state
+    deflate_optimal(z_params& zs, Flush flush)
+    {
+        return f_optimal(zs, flush);
+    }
+
+    block_state
+    deflate_quick(z_params& zs, Flush flush)
+    {
+        return f_quick(zs, flush);
+    }
+
+    block_state
+    deflate_adaptive(z_params& zs, Flush flush)
+    {
+        return f_adaptive(zs, flush);
+    }
 };
 
 //--------------------------------------------------------------------------
@@ -745,8 +1358,11 @@ bi_reverse(Unsigned code, unsigned len)
 } // deflate
 } // boost
 
+#include <boost/deflate/detail/impl/deflate_stream.hpp>
+
 #ifdef BOOST_DEFLATE_HEADER_ONLY
 #include <boost/deflate/detail/deflate_stream.ipp>
+#include <boost/deflate/detail/prepared_dictionary.ipp>
 #endif
 
 #endif
@@ -39,15 +39,20 @@
 #define BOOST_DEFLATE_DETAIL_DEFLATE_STREAM_IPP
 
 #include <boost/deflate/detail/deflate_stream.hpp>
+#include <boost/deflate/detail/match_length.hpp>
 #include <boost/deflate/detail/ranges.hpp>
+#include <boost/deflate/detail/slide_hash.hpp>
 #include <boost/assert.hpp>
 #include <boost/config.hpp>
 #include <boost/make_unique.hpp>
 #include <boost/optional.hpp>
 #include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
@@ -142,6 +147,52 @@ gen_codes(ct_data *tree, int max_code, std::uint16_t *bl_count)
     }
 }
 
+/*  Combine the length and distance codes of the given trees with
+    the extra bits which follow them, for compress_block. Codes not
+    used by the block have a length of 0, or the guard put past the
+    last code by scan_tree, and are left out.
+*/
+void
+deflate_stream::
+pack_codes(
+    lut_type const& lut,
+    ct_data const* ltree,
+    ct_data const* dtree,
+    code_extra* lengths,
+    code_extra* dists)
+{
+    for(unsigned lc = 0; lc <= max_match - min_match; ++lc)
+    {
+        unsigned const code = lut.length_code[lc];
+        ct_data const& c = ltree[code + literals + 1];
+        auto& e = lengths[lc];
+        if(c.dl == 0 || c.dl > max_bits)
+        {
+            e = code_extra{0, 0, 0};
+            continue;
+        }
+        e.bits = c.fc;
+        // Length 258 has a code of its own, without extra bits
+        if(lut.extra_lbits[code] != 0)
+            e.bits |= (lc - lut.base_length[code]) << c.dl;
+        e.len = static_cast<std::uint8_t>(c.dl + lut.extra_lbits[code]);
+        e.shift = static_cast<std::uint8_t>(c.dl);
+    }
+    for(unsigned code = 0; code < dcodes; ++code)
+    {
+        ct_data const& c = dtree[code];
+        auto& e = dists[code];
+        if(c.dl == 0 || c.dl > max_bits)
+        {
+            e = code_extra{0, 0, 0};
+            continue;
+        }
+        e.bits = c.fc - (std::uint32_t{lut.base_dist[code]} << c.dl);
+        e.len = static_cast<std::uint8_t>(c.dl + lut.extra_dbits[code]);
+        e.shift = static_cast<std::uint8_t>(c.dl);
+    }
+}
+
 auto
 deflate_stream::get_lut() ->
     lut_type const&
@@ -220,6 +271,20 @@ deflate_stream::get_lut() ->
                 tables.dtree[n].fc =
                     static_cast<std::uint16_t>(bi_reverse(n, 5));
             }
+
+            // Each bit length code takes at least one bit, plus its extra bits
+            tables.zero_run_bits[0] = 0;
+            for(n = 1; n <= lcodes; ++n)
+            {
+                unsigned bits = tables.zero_run_bits[n - 1] + 1;
+                for(unsigned k = 3; k <= n && k <= 138; ++k)
+                    bits = (std::min)(bits, tables.zero_run_bits[n - k] +
+                        (k <= 10 ? 1U + 3 : 1U + 7));
+                tables.zero_run_bits[n] = static_cast<std::uint8_t>(bits);
+            }
+
+            pack_codes(tables, tables.ltree, tables.dtree,
+                tables.static_lengths, tables.static_dists);
         }
     };
     static init const data;
@@ -242,7 +307,7 @@ doReset(
     if(windowBits == 8)
         windowBits = 9;
 
-    if(level < 0 || level > 9)
+    if(level < 0 || level > max_level)
         BOOST_THROW_EXCEPTION(std::invalid_argument{
             "invalid level"});
 
@@ -259,7 +324,7 @@ doReset(
     hash_bits_ = memLevel + 7;
 
     // 16K elements by default
-    lit_bufsize_ = 1 << (memLevel + 6);
+    lit_bits_ = memLevel + 6;
 
     level_ = level;
     strategy_ = strategy;
@@ -293,11 +358,25 @@ doUpperBound(std::size_t sourceLen) const
     complen = sourceLen +
               ((sourceLen + 7) >> 3) + ((sourceLen + 63) >> 6) + 5;
 
-    /* compute wrapper length */
-    wraplen = 0;
-
-    /* if not default parameters, return conservative bound */
-    if(w_bits_ != 15 || hash_bits_ != 8 + 7)
+    /* compute wrapper length, with the id of a dictionary */
+    switch(wrap_)
+    {
+    case boost::deflate::wrap::zlib:
+        wraplen = 6 + 4;
+        break;
+    case boost::deflate::wrap::gzip:
+        wraplen = 18;
+        break;
+    default:
+        wraplen = 0;
+        break;
+    }
+
+    /* if not default parameters, or if static blocks are written
+     * without a choice of stored blocks, return conservative bound */
+    if(w_bits_ != 15 || hash_bits_ != 8 + 7 ||
+            strategy_ == Strategy::quick ||
+            strategy_ == Strategy::adaptive || skip_ || large_)
         return complen + wraplen;
 
     /* default settings: return tight bound for that case */
@@ -311,12 +390,96 @@ doTune(
     int good_length,
     int max_lazy,
     int nice_length,
-    int max_chain)
+    int max_chain,
+    int min_length)
 {
+    if(min_length != min_match && min_length != min_match + 1)
+        BOOST_THROW_EXCEPTION(std::invalid_argument{
+            "invalid min_length"});
+    if(min_length != min_match && level_func(level_) != &self::deflate_fast)
+        BOOST_THROW_EXCEPTION(std::invalid_argument{
+            "min_length needs a fast level"});
+
+    // The parameters would be replaced by those of the level otherwise
+    maybe_init();
+
     good_match_ = good_length;
     nice_match_ = nice_length;
     max_lazy_match_ = max_lazy;
     max_chain_length_ = max_chain;
+
+    /*  Matches of min_length_-1 bytes are rejected in longest_match,
+        which only looks for matches longer than prev_length_.
+    */
+    if(level_func(level_) == &self::deflate_fast)
+    {
+        min_length_ = min_length;
+        prev_length_ = min_length - 1;
+    }
+}
+
+void
+deflate_stream::
+doHash(Hash hash)
+{
+    hash_ = hash;
+    inited_ = false;
+}
+
+void
+deflate_stream::
+doMatchFinder(MatchFinder finder)
+{
+    finder_ = finder;
+    inited_ = false;
+}
+
+void
+deflate_stream::
+doMedium(bool on)
+{
+    medium_ = on;
+    inited_ = false;
+}
+
+void
+deflate_stream::
+doBlockSplit(bool on)
+{
+    split_ = on;
+}
+
+void
+deflate_stream::
+doReuseTrees(bool on)
+{
+    reuse_ = on;
+    if(on && ! trees_)
+        trees_ = boost::make_unique<tree_cache>();
+}
+
+void
+deflate_stream::
+doLargeBlocks(bool on)
+{
+    large_ = on;
+    inited_ = false;
+}
+
+void
+deflate_stream::
+doStoreIncompressible(bool on)
+{
+    skip_ = on;
+    inited_ = false;
+}
+
+void
+deflate_stream::
+doLongPositions(bool on)
+{
+    long_ = on;
+    inited_ = false;
 }
 
 void
@@ -327,21 +490,42 @@ doParams(z_params& zs, int level, Strategy strategy, error_code& ec)
 
     if(level == default_size)
         level = 6;
-    if(level < 0 || level > 9)
+    if(level < 0 || level > max_level)
+    {
+        ec = error::stream_error;
+        return;
+    }
+    // The hash chains cannot go back to 16 bit positions
+    if(wide_ && ! keeps_positions(level, strategy))
     {
         ec = error::stream_error;
         return;
     }
-    func = get_config(level_).func;
+    func = level_func(level_);
+    bool const changed =
+        strategy != strategy_ || func != level_func(level);
 
-    if((strategy != strategy_ || func != get_config(level).func) &&
-        zs.total_in != 0)
+    if(changed && zs.total_in != 0)
     {
         // Flush the last buffer:
         doWrite(zs, Flush::block, ec);
-        if(ec == error::need_buffers && pending_ == 0)
+        if(ec == error::need_buffers)
             ec = {};
+        if(ec)
+            return;
+
+        /*  Input the old engine has not sent yet, a match it holds or
+            an open quick block cannot be handed to the new one.
+        */
+        if( zs.avail_in != 0 || block_open_ != 0 ||
+            static_cast<long>(strstart_) - block_start_ + lookahead_ != 0)
+        {
+            ec = error::need_buffers;
+            return;
+        }
     }
+    if(changed || level_ != level)
+        catch_up_hash();
     if(level_ != level)
     {
         level_ = level;
@@ -349,8 +533,27 @@ doParams(z_params& zs, int level, Strategy strategy, error_code& ec)
         good_match_       = get_config(level).good_length;
         nice_match_       = get_config(level).nice_length;
         max_chain_length_ = get_config(level).max_chain;
+        if(min_length_ != min_match)
+        {
+            min_length_ = min_match;
+            prev_length_ = min_match - 1;
+        }
+        if(level >= optimal_size && ! opt_)
+            opt_ = boost::make_unique<optimal_state>();
     }
     strategy_ = strategy;
+
+    // Strategy::adaptive chooses the engine of its next chunk again
+    if(changed)
+    {
+        // The new engine starts without a match, as after a chunk
+        match_length_ = min_match - 1;
+        prev_length_ = min_length_ - 1;
+        match_available_ = 0;
+        adaptive_func_ = nullptr;
+        adaptive_left_ = 0;
+        store_ = false;
+    }
 }
 
 // VFALCO boost::optional param is a workaround for
@@ -359,14 +562,16 @@ doParams(z_params& zs, int level, Strategy strategy, error_code& ec)
 //
 void
 deflate_stream::
-doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
+doWrite(
+    z_params& zs,
+    boost::optional<Flush> flush,
+    error_code& ec,
+    compress_func engine)
 {
-///NONE
     auto hcrc_update = [&](unsigned long beg) {
       if (gzhead_->hcrc && pending_ > beg)
             zs.check = crc32(pending_buf_ + beg,pending_ - beg, zs.check);
     };
-///~NONE
 
     maybe_init();
 
@@ -427,14 +632,15 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
         return;
     }
 
-///ZLIB|DYN
     // Write the header
     if(status_ == StreamStatus::head_state) {
         // zlib header
         std::uint16_t header = (ZMTH_DEFLATED | (w_bits_ - 8)
                                 << ZCINFO_MASK_TZ) << 8;
         std::uint16_t lvl_flags = 3;
-        if(strategy_ >= Strategy::huffman || level_ < 2)
+        if( strategy_ == Strategy::huffman ||
+            strategy_ == Strategy::rle ||
+            strategy_ == Strategy::fixed || level_ < 2)
             lvl_flags = 0;
         else if (level_ < 6)
             lvl_flags = 1;
@@ -450,8 +656,8 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
 
         // Save the adler32 of the preset dictionary
         if(strstart_ != 0){
-            put_short_msb(zs.check >> 16);
-            put_short_msb(zs.check & 0xffff);
+            put_short_msb(dict_id_ >> 16);
+            put_short_msb(dict_id_ & 0xffff);
         }
         zs.check = adler32(nullptr, 0);
         status_ = BUSY_STATE;
@@ -463,8 +669,6 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
             return;
         }
     }
-///~ZLIB|DYN
-///GZIP|DYN
     if(status_ == StreamStatus::gzip_state) {
         // gzip
         zs.check = crc32(nullptr, 0);
@@ -472,14 +676,18 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
         put_byte(31);
         put_byte(139);
         put_byte(8);
-        if(gzhead_){
+        // Extra flags, 4 for the fastest algorithm as in zlib
+        std::uint8_t const xfl = level_ >= 9 ? 2 :
+            (strategy_ == Strategy::huffman ||
+             strategy_ == Strategy::rle ||
+             strategy_ == Strategy::fixed || level_ < 2) ? 4 : 0;
+        if(! gzhead_){
             put_byte(0);
             put_byte(0);
             put_byte(0);
             put_byte(0);
             put_byte(0);
-            put_byte(level_ == 9 ? 2
-                     : (strategy_ >= Strategy::huffman || level_ < 2) ? 4 : 0);
+            put_byte(xfl);
             //FIXME add proper OS code
             put_byte(3); //Unix
             status_ = BUSY_STATE;
@@ -496,8 +704,7 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
                      (!gzhead_->name.empty()    ? FNAME  : 0) +
                      (!gzhead_->comment.empty() ? FTEXT  : 0));
             put_long(gzhead_->time);
-            put_byte(level_ == 9 ? 2
-                     : (strategy_ >= Strategy::huffman || level_ < 2) ? 4 : 0);
+            put_byte(xfl);
             put_byte(static_cast<std::uint8_t>(gzhead_->os));
 
             put_short(gzhead_->extra.size());
@@ -599,7 +806,6 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
             return;
         }
     }
-///~GZIP|DYN
 
     /* Start a new block or continue the current one.
      */
@@ -608,7 +814,21 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
     {
         block_state bstate;
 
-        switch(strategy_)
+        /* All of the input in one call which finishes the stream is
+         * compressed where it is, without copying it to the window.
+         */
+        if(flush == Flush::finish && zs.total_in == 0 &&
+            strstart_ == 0 && lookahead_ == 0 && level_ != 0 &&
+            zs.avail_in > borrow_margin && ! skip_ && ! wide_ &&
+            strategy_ != Strategy::adaptive)
+            borrow_window(zs);
+
+        if(engine)
+        {
+            // fixed at compile time, see params
+            bstate = (this->*engine)(zs, flush.get());
+        }
+        else switch(strategy_)
         {
         case Strategy::huffman:
             bstate = deflate_huff(zs, flush.get());
@@ -616,13 +836,33 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
         case Strategy::rle:
             bstate = deflate_rle(zs, flush.get());
             break;
+        case Strategy::quick:
+            bstate = deflate_quick(zs, flush.get());
+            break;
+        case Strategy::adaptive:
+            bstate = deflate_adaptive(zs, flush.get());
+            break;
         default:
         {
-            bstate = (this->*(get_config(level_).func))(zs, flush.get());
+            if(skip_ && level_ != 0)
+                bstate = deflate_adaptive(zs, flush.get());
+            else
+                bstate = (this->*(level_func(level_)))(zs, flush.get());
             break;
         }
         }
 
+        /* The caller's buffer may change before the next call, unless
+         * all of the input has been compressed.
+         */
+        if(borrowed())
+        {
+            if(bstate == finish_started || bstate == finish_done)
+                window_ = reinterpret_cast<Byte*>(buf_.get());
+            else
+                own_window();
+        }
+
         if(bstate == finish_started || bstate == finish_done)
         {
             status_ = FINISH_STATE;
@@ -658,6 +898,7 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
                 if(flush == Flush::full)
                 {
                     clear_hash(); // forget history
+                    stale_hash_ = 0;
                     if(lookahead_ == 0)
                     {
                         strstart_ = 0;
@@ -678,51 +919,55 @@ doWrite(z_params& zs, boost::optional<Flush> flush, error_code& ec)
     if(flush != Flush::finish)
         return;
 
-///DYN
     if(wrap_ == boost::deflate::wrap::none) {
-///~DYN
-///DYN|NONE
         ec = error::end_of_stream;
         return;
-///~DYN|NONE
-///DYN
     }
-///~DYN
 
     // Write the trailer
-///GZIP|DYN
     if(wrap_ == boost::deflate::wrap::gzip) {
         put_long(zs.check);
         put_long(zs.total_in);
     }
-///~GZIP|DYN
-///DYN
     else
-///~DYN
-///ZLIB|DYN
         put_long_msb(zs.check);
-///~ZLIB|DYN
-///!NONE
     flush_pending(zs);
     // If avail_out is zero, the application will call deflate again
     // to flush the rest
     if(pending_ == 0) // write the trailer only once!
         ec = error::end_of_stream;
-///~!NONE
 }
 
-// VFALCO Warning: untested
 void
 deflate_stream::
-doDictionary(Byte const* dict, uInt dictLength, error_code& ec)
+doDictionary(Byte const* dict, std::size_t size, error_code& ec)
 {
-    if(lookahead_)
+    // lookahead_ is only meaningful once the stream is initialized
+    maybe_init();
+
+    /*  The gzip header has no room for a dictionary, and the zlib
+        header only names one which is set before it is written.
+    */
+    if( lookahead_ || wrap_ == boost::deflate::wrap::gzip ||
+        (wrap_ == boost::deflate::wrap::zlib && status_ != head_state))
     {
         ec = error::stream_error;
         return;
     }
 
-    maybe_init();
+    /*  The zlib header identifies the dictionary by the adler32 of
+        all of its bytes, though only the last max_size can be used.
+    */
+    dict_id_ = adler32(nullptr, 0);
+    for(std::size_t i = 0; i < size; i += 0x40000000)
+        dict_id_ = adler32(dict + i, static_cast<unsigned>(
+            (std::min<std::size_t>)(size - i, 0x40000000)), dict_id_);
+    if(size > prepared_dictionary::max_size)
+    {
+        dict += size - prepared_dictionary::max_size;
+        size = prepared_dictionary::max_size;
+    }
+    auto dictLength = static_cast<uInt>(size);
 
     /* if dict would fill window, just replace the history */
     if(dictLength >= w_size_)
@@ -736,7 +981,7 @@ doDictionary(Byte const* dict, uInt dictLength, error_code& ec)
     }
 
     /* insert dict into window and hash */
-    z_params zs;
+    z_params zs{};
     zs.avail_in = dictLength;
     zs.next_in = (const Byte *)dict;
     zs.avail_out = 0;
@@ -748,9 +993,7 @@ doDictionary(Byte const* dict, uInt dictLength, error_code& ec)
         uInt n = lookahead_ - (min_match - 1);
         do
         {
-            update_hash(ins_h_, window_[str + min_match - 1]);
-            prev_[str & w_mask_] = head_[ins_h_];
-            head_[ins_h_] = (std::uint16_t)str;
+            insert_string_at(str);
             str++;
         }
         while(--n);
@@ -766,14 +1009,61 @@ doDictionary(Byte const* dict, uInt dictLength, error_code& ec)
     match_available_ = 0;
 }
 
+void
+deflate_stream::
+doDictionary(prepared_dictionary const& dict, error_code& ec)
+{
+    maybe_init();
+
+    if( lookahead_ || wrap_ == boost::deflate::wrap::gzip ||
+        (wrap_ == boost::deflate::wrap::zlib && status_ != head_state))
+    {
+        ec = error::stream_error;
+        return;
+    }
+
+    /*  The prepared tables only describe an empty window with
+        the same layout and hash function as this stream.
+    */
+    if( strstart_ != 0 || tree_ || wide_ ||
+        min_length_ != min_match ||
+        w_bits_ != dict.w_bits_ ||
+        hash_bits_ != dict.hash_bits_ ||
+        hash_ != dict.hash_)
+    {
+        doDictionary(dict.data_.data(), dict.data_.size(), ec);
+        dict_id_ = dict.id_;
+        return;
+    }
+
+    auto const n = dict.strstart_;
+    std::memcpy(window_,
+        dict.data_.data() + dict.data_.size() - n, n);
+    std::memcpy(head_, dict.head_.data(),
+        hash_size_ * sizeof(*head_));
+    std::memcpy(prev_, dict.prev_.data(), n * sizeof(*prev_));
+    if(high_water_ < n)
+        high_water_ = n;
+    strstart_ = n;
+    block_start_ = (long)strstart_;
+    insert_ = dict.insert_;
+    ins_h_ = dict.ins_h_;
+    dict_id_ = dict.id_;
+    match_length_ = prev_length_ = min_match - 1;
+    match_available_ = 0;
+}
+
 void
 deflate_stream::
 doPrime(int bits, int value, error_code& ec)
 {
     maybe_init();
 
+    // The symbols of large blocks do not follow the pending output
+    Byte const* const end = large_ ?
+        pending_buf_ + pending_buf_size_ : sym_buf_;
     if(bits < 0 || bits > 16 ||
-        (Byte *)(d_buf_) < pending_out_ + ((buf_size + 7) >> 3))
+        end < pending_out_ + ((buf_size + 7) >> 3))
     {
         ec = error::need_buffers;
         return;
@@ -784,7 +1074,8 @@ doPrime(int bits, int value, error_code& ec)
         int put = buf_size - bi_valid_;
         if(put > bits)
             put = bits;
-        bi_buf_ |= (std::uint16_t)((value & ((1 << put) - 1)) << bi_valid_);
+        bi_buf_ |= static_cast<std::uint64_t>(
+            value & ((1 << put) - 1)) << bi_valid_;
         bi_valid_ += put;
         tr_flush_bits();
         value >>= put;
@@ -813,22 +1104,37 @@ init()
     //  Caller must set these:
     //      w_bits_
     //      hash_bits_
-    //      lit_bufsize_
+    //      lit_bits_
     //      level_
     //      strategy_
 
     w_size_ = 1 << w_bits_;
     w_mask_ = w_size_ - 1;
 
+    lit_bufsize_ = 1 << (lit_bits_ + (large_ ? large_block_shift : 0));
+
     hash_size_ = 1 << hash_bits_;
     hash_mask_ = hash_size_ - 1;
     hash_shift_ =  ((hash_bits_ + min_match - 1) / min_match);
 
-    auto const nwindow  = w_size_ * 2*sizeof(Byte);
-    auto const nprev    = w_size_ * sizeof(std::uint16_t);
-    auto const nhead    = hash_size_ * sizeof(std::uint16_t);
+    // The binary tree has two links per string
+    tree_ = uses_tree(finder_, level_);
+
+    /*  Long positions take twice the memory for the hash chains,
+        and a window of 1 << long_window_shift times the window size.
+    */
+    wide_ = long_ && ! tree_ && keeps_positions(level_, strategy_);
+    auto const npos     = wide_ ?
+        sizeof(std::uint32_t) : sizeof(std::uint16_t);
+
+    auto const nwindow  = wide_ ?
+        w_size_ << long_window_shift : w_size_ * 2*sizeof(Byte);
+    auto const nprev    = w_size_ * npos * (tree_ ? 2 : 1);
+    auto const nhead    = hash_size_ * npos;
     auto const noverlay = lit_bufsize_ * (sizeof(std::uint16_t)+2);
-    auto const needed   = nwindow + nprev + nhead + noverlay;
+    auto const nsym     = large_ ?
+        lit_bufsize_ * (sizeof(std::uint16_t)+1) : 0;
+    auto const needed   = nwindow + nprev + nhead + noverlay + nsym;
 
     if(! buf_ || buf_size_ != needed)
     {
@@ -842,9 +1148,11 @@ init()
     std::memset(prev_, 0, nprev);
     head_   = reinterpret_cast<std::uint16_t*>(buf_.get() + nwindow + nprev);
 
-    /*  We overlay pending_buf_ and d_buf_ + l_buf_. This works
-        since the average output size for(length, distance)
-        codes is <= 24 bits.
+    /*  We overlay pending_buf_ and sym_buf_. This works since
+        the average output size for(length, distance) codes is
+        <= 24 bits. Large blocks keep sym_buf_ after pending_buf_
+        instead, which then holds a whole block coded with the
+        static trees, at most 31 bits per symbol.
     */
     auto overlay = reinterpret_cast<std::uint16_t*>(
         buf_.get() + nwindow + nprev + nhead);
@@ -858,14 +1166,31 @@ init()
         static_cast<std::uint32_t>(lit_bufsize_) *
             (sizeof(std::uint16_t) + 2L);
 
-    d_buf_ = overlay + lit_bufsize_ / sizeof(std::uint16_t);
-    l_buf_ = pending_buf_ + (1 + sizeof(std::uint16_t)) * lit_bufsize_;
+    sym_buf_ = large_ ?
+        pending_buf_ + pending_buf_size_ :
+        pending_buf_ + lit_bufsize_;
+    sym_end_ = (lit_bufsize_ - 1) * 3;
 
     pending_ = 0;
     pending_out_ = pending_buf_;
 
-    status_ = BUSY_STATE;
+    // The header of the wrapper is written by the first write
+    status_ =
+        wrap_ == boost::deflate::wrap::zlib ? head_state :
+        wrap_ == boost::deflate::wrap::gzip ? gzip_state :
+        BUSY_STATE;
+    gzhead_ = nullptr;
     last_flush_ = Flush::none;
+    dict_id_ = 0;
+
+    stats_ = {};
+
+    adaptive_func_ = nullptr;
+    adaptive_left_ = 0;
+    store_ = false;
+
+    if(level_ >= optimal_size && ! opt_)
+        opt_ = boost::make_unique<optimal_state>();
 
     tr_init();
     lm_init();
@@ -879,7 +1204,8 @@ void
 deflate_stream::
 lm_init()
 {
-    window_size_ = (std::uint32_t)2L*w_size_;
+    window_size_ = wide_ ?
+        w_size_ << long_window_shift : (std::uint32_t)2L*w_size_;
 
     clear_hash();
 
@@ -889,14 +1215,19 @@ lm_init()
     good_match_       = get_config(level_).good_length;
     nice_match_       = get_config(level_).nice_length;
     max_chain_length_ = get_config(level_).max_chain;
+    min_length_       = min_match;
 
     strstart_ = 0;
     block_start_ = 0L;
     lookahead_ = 0;
     insert_ = 0;
+    stale_hash_ = 0;
     match_length_ = prev_length_ = min_match - 1;
     match_available_ = 0;
     ins_h_ = 0;
+    input_end_ = 0;
+    bt_len_ = 0;
+    bt_nice_ = nice_match_;
 }
 
 // Initialize a new block.
@@ -914,8 +1245,9 @@ init_block()
     dyn_ltree_[end_block].fc = 1;
     opt_len_ = 0L;
     static_len_ = 0L;
-    last_lit_ = 0;
+    sym_next_ = 0;
     matches_ = 0;
+    split_stats_ = {};
 }
 
 /*  Restore the heap property by moving down the tree starting at node k,
@@ -987,7 +1319,7 @@ gen_bitlen(tree_desc *desc)
     int n, m;                       // iterate over the tree elements
     int bits;                       // bit length
     int xbits;                      // extra bits
-    std::uint16_t f;                // frequency
+    std::uint32_t f;                // frequency
     int overflow = 0;               // number of elements with bit length too large
 
     std::fill(&bl_count_[0], &bl_count_[max_bits + 1], std::uint16_t{0});
@@ -1361,7 +1693,198 @@ send_all_trees(
     send_tree((ct_data *)dyn_dtree_, dcodes-1); // distance tree
 }
 
-/*  Send the block data compressed using the given Huffman trees
+/*  Return true if dynamic trees cannot give a smaller block than the
+    static trees, or than a stored block when stored is true, setting
+    static_len as build_tree would. This compares a lower bound on the
+    size of the block with dynamic trees: the counts and four bit
+    length codes, the fewest bits which can describe the literal tree,
+    and the entropy of the symbols, which no code goes below. When it
+    returns true, the type chosen after building the trees would have
+    been the same, so the output does not change.
+    IN assertion: the fields fc of dyn_ltree and dyn_dtree are set.
+*/
+bool
+deflate_stream::
+dynamic_loses(std::uint32_t stored_len, bool stored)
+{
+    std::uint32_t static_bits = 0;
+    std::uint32_t extra_bits = 0;
+    std::uint32_t half_bits = 0;  // tree description, in half bits
+    int used = 0;
+    int max_code = 0;
+    double entropy = 0;
+    auto const scan =
+        [&](ct_data const* tree, static_desc const& desc)
+        {
+            std::uint32_t total = 0;
+            double sum = 0;
+            for(int n = 0; n < desc.elems; ++n)
+            {
+                std::uint32_t const f = tree[n].fc;
+                if(f == 0)
+                    continue;
+                int const xbits = n >= desc.extra_base ?
+                    desc.extra_bits[n - desc.extra_base] : 0;
+                total += f;
+                sum += f * std::log2(static_cast<double>(f));
+                extra_bits += f * xbits;
+                static_bits += f * (desc.static_tree[n].dl + xbits);
+                max_code = n;
+                ++used;
+            }
+            if(total != 0)
+                entropy += total *
+                    std::log2(static_cast<double>(total)) - sum;
+        };
+    scan(dyn_ltree_, lut_.l_desc);
+
+    // With fewer than two codes build_tree adds some
+    if(used < 2)
+        return false;
+
+    /*  The lengths up to max_code are sent. A non zero length takes a
+        code of at least one bit, or a share of at least half a bit of
+        a repeat, and a run of zeros takes at least zero_run_bits.
+    */
+    int run = 0;
+    for(int n = 0; n <= max_code; ++n)
+    {
+        if(dyn_ltree_[n].fc == 0)
+        {
+            ++run;
+            continue;
+        }
+        half_bits += 2 * lut_.zero_run_bits[run] + 1;
+        run = 0;
+    }
+    scan(dyn_dtree_, lut_.d_desc);
+
+    std::uint32_t const static_lenb = (static_bits + 3 + 7) >> 3;
+    // 5+5+4 bits of counts, 4 bit length codes and one distance length
+    double const dynamic_bits = 5 + 5 + 4 + 4 * 3 + 1 +
+        half_bits / 2.0 + entropy + extra_bits;
+    double const dynamic_lenb = (dynamic_bits + 3 + 7) / 8 - 1;
+    if( static_lenb > dynamic_lenb && ! (stored &&
+        stored_len + 4 <= dynamic_lenb &&
+        stored_len + 4 <= static_lenb))
+        return false;
+    static_len_ = static_bits;
+    return true;
+}
+
+/*  Decide whether the saved trees are sent again for the current
+    block, setting opt_len and static_len as build_tree would if so.
+    The cost of the saved codes on the block's frequencies is compared
+    with the entropy of the symbols, scaled by how close the last fresh
+    trees came to the entropy of their own block, which estimates the
+    cost of fresh trees without building them. The saved trees are
+    used when they cost at most 1/128 more, and code every symbol
+    of the block.
+    IN assertion: the fields fc of dyn_ltree and dyn_dtree are set.
+*/
+bool
+deflate_stream::
+try_saved_trees()
+{
+    auto& c = *trees_;
+    double entropy = 0;
+    std::uint32_t extra_bits = 0;
+    std::uint32_t static_bits = 0;
+    std::uint32_t saved_bits = 0;
+    bool fits = c.valid;
+    auto const scan =
+        [&](ct_data const* tree, ct_data const* saved,
+            static_desc const& desc)
+        {
+            std::uint32_t total = 0;
+            double sum = 0;
+            for(int n = 0; n < desc.elems; ++n)
+            {
+                std::uint32_t const f = tree[n].fc;
+                if(f == 0)
+                    continue;
+                int const xbits = n >= desc.extra_base ?
+                    desc.extra_bits[n - desc.extra_base] : 0;
+                total += f;
+                sum += f * std::log2(static_cast<double>(f));
+                extra_bits += f * xbits;
+                static_bits += f * (desc.static_tree[n].dl + xbits);
+                saved_bits += f * saved[n].dl;
+                fits = fits && saved[n].dl != 0;
+            }
+            if(total != 0)
+                entropy += total *
+                    std::log2(static_cast<double>(total)) - sum;
+        };
+    scan(dyn_ltree_, c.ltree, lut_.l_desc);
+    scan(dyn_dtree_, c.dtree, lut_.d_desc);
+    c.entropy = entropy;
+    c.extra_bits = extra_bits;
+    if(! fits || saved_bits > entropy * c.ratio * (1 + 1.0 / 128))
+        return false;
+    opt_len_ = saved_bits + extra_bits + c.header_bits;
+    static_len_ = static_bits;
+    return true;
+}
+
+/*  Save the trees just built, and their description, for the blocks
+    after the current one. code_bits is the cost of the codes on the
+    block's frequencies, without the extra bits.
+*/
+void
+deflate_stream::
+save_trees(int max_blindex, std::uint32_t code_bits)
+{
+    auto& c = *trees_;
+    auto const save =
+        [](ct_data* to, ct_data const* tree, int max_code, int elems)
+        {
+            std::copy(tree, tree + max_code + 1, to);
+            // send_tree put a guard past max_code
+            std::fill(to + max_code + 1, to + elems, ct_data{0, 0});
+        };
+    save(c.ltree, dyn_ltree_, l_desc_.max_code, lcodes);
+    save(c.dtree, dyn_dtree_, d_desc_.max_code, dcodes);
+    c.ratio = c.entropy > 0 ? (code_bits - c.extra_bits) / c.entropy : 1;
+
+    // Send the description into the cache instead of the pending output
+    auto const buf = bi_buf_;
+    auto const valid = bi_valid_;
+    auto const pending = pending_;
+    auto const out = pending_buf_;
+    bi_buf_ = 0;
+    bi_valid_ = 0;
+    pending_ = 0;
+    pending_buf_ = c.header;
+    send_all_trees(l_desc_.max_code+1, d_desc_.max_code+1,
+                   max_blindex+1);
+    c.header_bits = static_cast<std::uint32_t>(8 * pending_ + bi_valid_);
+    put_bits64(bi_buf_);
+    BOOST_ASSERT(pending_ <= tree_cache::header_size);
+    bi_buf_ = buf;
+    bi_valid_ = valid;
+    pending_ = pending;
+    pending_buf_ = out;
+    c.valid = true;
+}
+
+// Send the description of the saved trees
+void
+deflate_stream::
+send_saved_trees()
+{
+    auto const& c = *trees_;
+    Byte const* p = c.header;
+    auto bits = c.header_bits;
+    for(; bits >= 16; bits -= 16, p += 2)
+        send_bits(p[0] | (p[1] << 8), 16);
+    if(bits != 0)
+        send_bits((p[0] | (p[1] << 8)) & ((1U << bits) - 1), bits);
+}
+
+/*  Send the block data compressed using the given Huffman trees.
+    Each match is sent at once, its length and distance codes with
+    their extra bits taken from tables built for the trees.
 */
 void
 deflate_stream::
@@ -1369,53 +1892,47 @@ compress_block(
     ct_data const* ltree, // literal tree
     ct_data const* dtree) // distance tree
 {
-    unsigned dist;      /* distance of matched string */
-    int lc;             /* match length or unmatched char (if dist == 0) */
-    unsigned lx = 0;    /* running index in l_buf */
-    unsigned code;      /* the code to send */
-    int extra;          /* number of extra bits to send */
+    code_extra lengths[max_match - min_match + 1];
+    code_extra dists[dcodes];
+    code_extra const* lp = lut_.static_lengths;
+    code_extra const* dp = lut_.static_dists;
+    if(ltree != lut_.ltree && sym_next_ != 0)
+    {
+        pack_codes(lut_, ltree, dtree, lengths, dists);
+        lp = lengths;
+        dp = dists;
+    }
 
-    if(last_lit_ != 0)
+    bit_cursor bc{bi_buf_, bi_valid_, pending_buf_ + pending_};
+    for(uInt sx = 0; sx < sym_next_; sx += 3)
     {
-        do
+        unsigned dist = sym_buf_[sx];   // distance of matched string
+        dist += static_cast<unsigned>(sym_buf_[sx + 1]) << 8;
+        unsigned const lc = sym_buf_[sx + 2];   // match length or literal
+        if(dist == 0)
         {
-            dist = d_buf_[lx];
-            lc = l_buf_[lx++];
-            if(dist == 0)
-            {
-                send_code(lc, ltree); /* send a literal byte */
-            }
-            else
-            {
-                /* Here, lc is the match length - min_match */
-                code = lut_.length_code[lc];
-                send_code(code+literals+1, ltree); /* send the length code */
-                extra = lut_.extra_lbits[code];
-                if(extra != 0)
-                {
-                    lc -= lut_.base_length[code];
-                    send_bits(lc, extra);       /* send the extra length bits */
-                }
-                dist--; /* dist is now the match distance - 1 */
-                code = d_code(dist);
-                BOOST_ASSERT(code < dcodes);
-
-                send_code(code, dtree);       /* send the distance code */
-                extra = lut_.extra_dbits[code];
-                if(extra != 0)
-                {
-                    dist -= lut_.base_dist[code];
-                    send_bits(dist, extra);   /* send the extra distance bits */
-                }
-            } /* literal or match pair ? */
-
-            /* Check that the overlay between pending_buf and d_buf+l_buf is ok: */
-            BOOST_ASSERT((uInt)(pending_) < lit_bufsize_ + 2*lx);
+            bc.send_code(lc, ltree); /* send a literal byte */
+        }
+        else
+        {
+            /* Here, lc is the match length - min_match */
+            code_extra const& l = lp[lc];
+            dist--; /* dist is now the match distance - 1 */
+            code_extra const& d = dp[d_code(dist)];
+            std::uint32_t const dbits = d.bits + (dist << d.shift);
+            bc.send_bits64(l.bits |
+                (static_cast<std::uint64_t>(dbits) << l.len),
+                l.len + d.len);
         }
-        while(lx < last_lit_);
-    }
 
-    send_code(end_block, ltree);
+        /* Check that the overlay between pending_buf and sym_buf is ok: */
+        BOOST_ASSERT(large_ || static_cast<uInt>(
+            bc.out - pending_buf_) < lit_bufsize_ + sx + 3);
+    }
+    bc.send_code(end_block, ltree);
+    bi_buf_ = bc.buf;
+    bi_valid_ = bc.valid;
+    pending_ = static_cast<uInt>(bc.out - pending_buf_);
 }
 
 /*  Check if the data type is TEXT or BINARY, using the following algorithm:
@@ -1466,10 +1983,12 @@ void
 deflate_stream::
 bi_windup()
 {
-    if(bi_valid_ > 8)
-        put_short(bi_buf_);
-    else if(bi_valid_ > 0)
+    while(bi_valid_ > 0)
+    {
         put_byte((Byte)bi_buf_);
+        bi_buf_ >>= 8;
+        bi_valid_ -= 8;
+    }
     bi_buf_ = 0;
     bi_valid_ = 0;
 }
@@ -1480,13 +1999,7 @@ void
 deflate_stream::
 bi_flush()
 {
-    if(bi_valid_ == 16)
-    {
-        put_short(bi_buf_);
-        bi_buf_ = 0;
-        bi_valid_ = 0;
-    }
-    else if(bi_valid_ >= 8)
+    while(bi_valid_ >= 8)
     {
         put_byte((Byte)bi_buf_);
         bi_buf_ >>= 8;
@@ -1535,6 +2048,9 @@ tr_init()
 
     bi_buf_ = 0;
     bi_valid_ = 0;
+    block_open_ = 0;
+    if(trees_)
+        trees_->valid = false;
 
     // Initialize the first block of the first file:
     init_block();
@@ -1547,6 +2063,7 @@ void
 deflate_stream::
 tr_align()
 {
+    ++stats_.static_blocks;
     send_bits(static_trees << 1, 3);
     send_code(end_block, lut_.ltree);
     bi_flush();
@@ -1570,6 +2087,7 @@ tr_stored_block(
     std::uint32_t stored_len,   // length of input block
     int last)                   // one if this is the last block for a file
 {
+    ++stats_.stored_blocks;
     send_bits((stored_blocks << 1) + last, 3);       // send block type
     copy_block(buf, (unsigned)stored_len, 1);   // with header
 }
@@ -1578,22 +2096,84 @@ void
 deflate_stream::
 tr_tally_dist(std::uint16_t dist, std::uint8_t len, bool& flush)
 {
-    d_buf_[last_lit_] = dist;
-    l_buf_[last_lit_++] = len;
+    sym_buf_[sym_next_++] = static_cast<std::uint8_t>(dist);
+    sym_buf_[sym_next_++] = static_cast<std::uint8_t>(dist >> 8);
+    sym_buf_[sym_next_++] = len;
     dist--;
     dyn_ltree_[lut_.length_code[len]+literals+1].fc++;
     dyn_dtree_[d_code(dist)].fc++;
-    flush = (last_lit_ == lit_bufsize_-1);
+    flush = (sym_next_ == sym_end_);
+    if(split_)
+    {
+        ++split_stats_.fresh[8 + (len >= 9 - min_match)];
+        if(++split_stats_.nfresh >= split_interval && split_check())
+            flush = true;
+    }
 }
 
 void
 deflate_stream::
 tr_tally_lit(std::uint8_t c, bool& flush)
 {
-    d_buf_[last_lit_] = 0;
-    l_buf_[last_lit_++] = c;
+    sym_buf_[sym_next_++] = 0;
+    sym_buf_[sym_next_++] = 0;
+    sym_buf_[sym_next_++] = c;
     dyn_ltree_[c].fc++;
-    flush = (last_lit_ == lit_bufsize_-1);
+    flush = (sym_next_ == sym_end_);
+    if(split_)
+    {
+        ++split_stats_.fresh[((c >> 5) & 6) | (c & 1)];
+        if(++split_stats_.nfresh >= split_interval && split_check())
+            flush = true;
+    }
+}
+
+/*  Return true if the current block should end because the symbols
+    tallied since the last check are distributed differently from
+    those before them. Both distributions are scaled to the same total
+    and the sum of the differences is compared with a threshold, which
+    is raised for small blocks as their statistics are less reliable,
+    and lowered as the block grows, since a longer block gains less
+    from keeping its trees. Building the trees to compare opt_len_ and
+    static_len_ at each check would cost more than the compression.
+*/
+bool
+deflate_stream::
+split_check()
+{
+    auto& s = split_stats_;
+    std::uint32_t const length =
+        static_cast<std::uint32_t>(strstart_ - block_start_);
+    if(length < split_min_length)
+        return false;
+    bool end = false;
+    if(s.nseen > 0)
+    {
+        std::uint64_t delta = 0;
+        for(int i = 0; i < split_state::classes; ++i)
+        {
+            std::uint64_t const expected =
+                std::uint64_t{s.seen[i]} * s.nfresh;
+            std::uint64_t const actual =
+                std::uint64_t{s.fresh[i]} * s.nseen;
+            delta += actual > expected ?
+                actual - expected : expected - actual;
+        }
+        std::uint64_t const items = s.nseen + s.nfresh;
+        std::uint64_t cutoff =
+            std::uint64_t{s.nfresh} * 200 / 512 * s.nseen;
+        if(length < 2 * split_min_length && items < 8192)
+            cutoff += cutoff * (8192 - items) / 8192;
+        end = delta + std::uint64_t{length / 4096} * s.nseen >= cutoff;
+    }
+    for(int i = 0; i < split_state::classes; ++i)
+    {
+        s.seen[i] += s.fresh[i];
+        s.fresh[i] = 0;
+    }
+    s.nseen += s.nfresh;
+    s.nfresh = 0;
+    return end;
 }
 
 //------------------------------------------------------------------------------
@@ -1612,30 +2192,54 @@ tr_flush_block(
     std::uint32_t opt_lenb;
     std::uint32_t static_lenb;  // opt_len and static_len in bytes
     int max_blindex = 0;        // index of last bit length code of non zero freq
+    std::uint32_t code_bits = 0;    // opt_len without the trees
+    bool saved = false;         // the saved trees are sent again
+    bool dynamic = true;        // dynamic trees were built or saved
+
+    /*  The length of a stored block has 16 bits. The long window of
+        long_positions keeps longer blocks in the window, and they are
+        coded as when their input has left it.
+    */
+    if(stored_len > 65535)
+        buf = nullptr;
 
     // Build the Huffman trees unless a stored block is forced
-    if(level_ > 0)
+    if(level_ > 0 && ! store_)
     {
         // Check if the file is binary or text
         if(zs.data_type == unknown)
             zs.data_type = detect_data_type();
 
-        // Construct the literal and distance trees
-        build_tree((tree_desc *)(&(l_desc_)));
+        if( sym_next_ <= 3 * small_block &&
+            dynamic_loses(stored_len, buf != nullptr))
+        {
+            // Building the trees is skipped
+            dynamic = false;
+        }
+        else if(reuse_ && try_saved_trees())
+        {
+            saved = true;
+        }
+        else
+        {
+            // Construct the literal and distance trees
+            build_tree((tree_desc *)(&(l_desc_)));
 
-        build_tree((tree_desc *)(&(d_desc_)));
-        /* At this point, opt_len and static_len are the total bit lengths of
-         * the compressed block data, excluding the tree representations.
-         */
+            build_tree((tree_desc *)(&(d_desc_)));
+            /* At this point, opt_len and static_len are the total bit lengths of
+             * the compressed block data, excluding the tree representations.
+             */
+            code_bits = opt_len_;
 
-        /* Build the bit length tree for the above two trees, and get the index
-         * in bl_order of the last bit length code to send.
-         */
-        max_blindex = build_bl_tree();
+            /* Build the bit length tree for the above two trees, and get the index
+             * in bl_order of the last bit length code to send.
+             */
+            max_blindex = build_bl_tree();
+        }
 
         /* Determine the best encoding. Compute the block lengths in bytes. */
-        opt_lenb = (opt_len_+3+7)>>3;
         static_lenb = (static_len_+3+7)>>3;
+        opt_lenb = dynamic ? (opt_len_+3+7)>>3 : static_lenb;
 
         if(static_lenb <= opt_lenb)
             opt_lenb = static_lenb;
@@ -1650,14 +2254,44 @@ tr_flush_block(
         BOOST_ASSERT(buf);
     #endif
         opt_lenb = static_lenb = stored_len + 5; // force a stored block
+
+        /*  A block longer than the pending buffer, which the huffman
+            and rle engines allow, is sent static as well.
+        */
+        if(stored_len + 5 + 2 * sizeof(bi_buf_) > pending_buf_size_)
+            buf = nullptr;
     }
 
 #ifdef FORCE_STORED
-    if(buf != nullptr) { /* force stored block */
+    bool const stored = buf != nullptr; /* force stored block */
 #else
-    if(stored_len+4 <= opt_lenb && buf != (char*)0) {
+    bool const stored = stored_len+4 <= opt_lenb && buf != (char*)0;
                        /* 4: two words for the lengths */
 #endif
+
+    /*  The block is written straight to the caller's buffer when no
+        output is pending and its size, known from the choice below,
+        fits with the bits left in the bit buffer. The pending buffer
+        is only used when the output is short, or when a forced stored
+        block cannot be sent because its input has left the window: the
+        static block sent instead was not measured.
+    */
+#if defined(FORCE_STORED) || defined(FORCE_STATIC)
+    std::uint32_t const block_lenb =
+        (std::max)(stored_len + 5, static_lenb);
+    bool const measured = level_ > 0 && ! store_;
+#else
+    std::uint32_t const block_lenb = stored ? stored_len + 5 :
+        strategy_ == Strategy::fixed ? static_lenb : opt_lenb;
+    bool const measured = stored || (level_ > 0 && ! store_);
+#endif
+    auto const spill = pending_buf_;
+    bool const direct = pending_ == 0 && measured &&
+        zs.avail_out >= block_lenb + 2 * sizeof(bi_buf_);
+    if(direct)
+        pending_buf_ = static_cast<Byte*>(zs.next_out);
+
+    if(stored) {
         /* The test buf != nullptr is only necessary if LIT_BUFSIZE > WSIZE.
          * Otherwise we can't have processed more than WSIZE input bytes since
          * the last block flush, because compression would have been
@@ -1676,16 +2310,34 @@ tr_flush_block(
     else if(strategy_ == Strategy::fixed || static_lenb == opt_lenb)
     {
 #endif
+        ++stats_.static_blocks;
         send_bits((static_trees << 1) + last, 3);
         compress_block(lut_.ltree, lut_.dtree);
     }
     else
     {
+        ++stats_.dynamic_blocks;
         send_bits((dynamic_trees << 1) + last, 3);
-        send_all_trees(l_desc_.max_code+1, d_desc_.max_code+1,
-                       max_blindex+1);
-        compress_block((const ct_data *)dyn_ltree_,
-                       (const ct_data *)dyn_dtree_);
+        if(saved)
+        {
+            send_saved_trees();
+            compress_block(trees_->ltree, trees_->dtree);
+        }
+        else
+        {
+            if(reuse_)
+            {
+                save_trees(max_blindex, code_bits);
+                send_saved_trees();
+            }
+            else
+            {
+                send_all_trees(l_desc_.max_code+1, d_desc_.max_code+1,
+                               max_blindex+1);
+            }
+            compress_block((const ct_data *)dyn_ltree_,
+                           (const ct_data *)dyn_dtree_);
+        }
     }
     /* The above check is made mod 2^32, for files larger than 512 MB
      * and std::size_t implemented on 32 bits.
@@ -1694,138 +2346,50 @@ tr_flush_block(
 
     if(last)
         bi_windup();
+
+    if(direct)
+    {
+        BOOST_ASSERT(pending_ <= block_lenb + 2 * sizeof(bi_buf_));
+        zs.next_out = pending_buf_ + pending_;
+        zs.total_out += pending_;
+        zs.avail_out -= pending_;
+        pending_ = 0;
+        pending_buf_ = spill;
+    }
 }
 
+/*  Make the window point into the caller's buffer, at the next byte of
+    input. The input is then read by moving the end of the lookahead,
+    and the window slides by moving the pointer. It stays valid while
+    borrow_margin bytes of the buffer are left unread.
+*/
 void
 deflate_stream::
-fill_window(z_params& zs)
+borrow_window(z_params& zs)
 {
-    unsigned n, m;
-    unsigned more;    // Amount of free space at the end of the window.
-    std::uint16_t *p;
-    uInt wsize = w_size_;
-
-    do
-    {
-        more = (unsigned)(window_size_ -
-            (std::uint32_t)lookahead_ -(std::uint32_t)strstart_);
+    BOOST_ASSERT(strstart_ == 0 && lookahead_ == 0);
+    window_ = const_cast<Byte*>(
+        static_cast<Byte const*>(zs.next_in));
+}
 
-        /*  If the window is almost full and there is insufficient lookahead,
-            move the upper half to the lower one to make room in the upper half.
-        */
-        if(strstart_ >= wsize+max_dist())
-        {
-            std::memcpy(window_, window_+wsize, (unsigned)wsize);
-            match_start_ -= wsize;
-            strstart_    -= wsize; // we now have strstart >= max_dist
-            block_start_ -= (long) wsize;
-            if(insert_ > strstart_)
-              insert_ = strstart_;
-
-            /* Slide the hash table (could be avoided with 32 bit values
-               at the expense of memory usage). We slide even when level == 0
-               to keep the hash table consistent if we switch back to level > 0
-               later. (Using level 0 permanently is not an optimal usage of
-               zlib, so we don't care about this pathological case.)
-            */
-            n = hash_size_;
-            p = &head_[n];
-            do
-            {
-                m = *--p;
-                *p = (std::uint16_t)(m >= wsize ? m-wsize : 0);
-            }
-            while(--n);
-
-            n = wsize;
-            p = &prev_[n];
-            do
-            {
-                m = *--p;
-                *p = (std::uint16_t)(m >= wsize ? m-wsize : 0);
-                /*  If n is not on any hash chain, prev[n] is garbage but
-                    its value will never be used.
-                */
-            }
-            while(--n);
-            more += wsize;
-        }
-        if(zs.avail_in == 0)
-            break;
-
-        /*  If there was no sliding:
-               strstart <= WSIZE+max_dist-1 && lookahead <= kmin_lookahead - 1 &&
-               more == window_size - lookahead - strstart
-            => more >= window_size - (kmin_lookahead-1 + WSIZE + max_dist-1)
-            => more >= window_size - 2*WSIZE + 2
-            In the BIG_MEM or MMAP case (not yet supported),
-              window_size == input_size + kmin_lookahead  &&
-              strstart + lookahead_ <= input_size => more >= kmin_lookahead.
-            Otherwise, window_size == 2*WSIZE so more >= 2.
-            If there was sliding, more >= WSIZE. So in all cases, more >= 2.
-        */
-        n = read_buf(zs, window_ + strstart_ + lookahead_, more);
-        lookahead_ += n;
-
-        // Initialize the hash value now that we have some input:
-        if(lookahead_ + insert_ >= min_match)
-        {
-            uInt str = strstart_ - insert_;
-            ins_h_ = window_[str];
-            update_hash(ins_h_, window_[str + 1]);
-            while(insert_)
-            {
-                update_hash(ins_h_, window_[str + min_match - 1]);
-                prev_[str & w_mask_] = head_[ins_h_];
-                head_[ins_h_] = (std::uint16_t)str;
-                str++;
-                insert_--;
-                if(lookahead_ + insert_ < min_match)
-                    break;
-            }
-        }
-        /*  If the whole input has less than min_match bytes, ins_h is garbage,
-            but this is not important since only literal bytes will be emitted.
-        */
-    }
-    while(lookahead_ < kmin_lookahead && zs.avail_in != 0);
-
-    /*  If the kwin_init bytes after the end of the current data have never been
-        written, then zero those bytes in order to avoid memory check reports of
-        the use of uninitialized (or uninitialised as Julian writes) bytes by
-        the longest match routines.  Update the high water mark for the next
-        time through here.  kwin_init is set to max_match since the longest match
-        routines allow scanning to strstart + max_match, ignoring lookahead.
-    */
-    if(high_water_ < window_size_)
-    {
-        std::uint32_t curr = strstart_ + (std::uint32_t)(lookahead_);
-        std::uint32_t winit;
-
-        if(high_water_ < curr)
-        {
-            /*  Previous high water mark below current data -- zero kwin_init
-                bytes or up to end of window, whichever is less.
-            */
-            winit = window_size_ - curr;
-            if(winit > kwin_init)
-                winit = kwin_init;
-            std::memset(window_ + curr, 0, (unsigned)winit);
-            high_water_ = curr + winit;
-        }
-        else if(high_water_ < (std::uint32_t)curr + kwin_init)
-        {
-            /*  High water mark at or above current data, but below current data
-                plus kwin_init -- zero out to current data plus kwin_init, or up
-                to end of window, whichever is less.
-            */
-            winit = (std::uint32_t)curr + kwin_init - high_water_;
-            if(winit > window_size_ - high_water_)
-                winit = window_size_ - high_water_;
-            std::memset(window_ + high_water_, 0, (unsigned)winit);
-            high_water_ += winit;
-        }
-    }
+/*  Copy the window out of the caller's buffer into the stream's own,
+    to continue with the input read as usual. The bytes past the input
+    are made the same as when the input had been read as usual: once
+    the window has slid, the upper half past the input still holds the
+    bytes which moved to the lower half.
+*/
+void
+deflate_stream::
+own_window()
+{
+    auto const w = reinterpret_cast<Byte*>(buf_.get());
+    std::uint32_t const end = strstart_ + lookahead_;
+    std::memcpy(w, window_, end);
+    if(high_water_ == window_size_)
+        std::memcpy(w + end, w + end - w_size_, window_size_ - end);
+    else
+        high_water_ = end;
+    window_ = w;
 }
 
 /*  Flush as much pending output as possible. All write() output goes
@@ -1870,247 +2434,329 @@ flush_block(z_params& zs, bool last)
    flush_pending(zs);
 }
 
-/*  Read a new buffer from the current input stream, update the adler32
-    and total number of bytes read.  All write() input goes through
-    this function so some applications may wish to modify it to avoid
-    allocating a large strm->next_in buffer and copying from it.
-    (See also flush_pending()).
+/*  Append to the candidate list of the optimal parser every match at
+    window index pos which is longer than the ones before it on the
+    hash chain, and return the length of the longest, or zero if there
+    is none. Matches are limited to the avail bytes of input at pos.
+    IN assertion: cur_match is the head of the hash chain for pos and
+        its distance is <= max_dist.
 */
-int
+uInt
 deflate_stream::
-read_buf(z_params& zs, Byte *buf, unsigned size)
+find_matches(uInt pos, IPos cur_match, uInt avail)
 {
-    auto len = clamp(zs.avail_in, size);
-    if(len == 0)
+    auto& matches = opt_->matches;
+    unsigned chain_length = max_chain_length_;
+    Byte *scan = window_ + pos;
+    uInt const max_len = avail < max_match ? avail : max_match;
+    uInt const nice_match = (uInt)nice_match_ < max_len ?
+        (uInt)nice_match_ : max_len;
+    uInt best_len = min_match - 1;
+    IPos limit = pos > (IPos)max_dist() ?
+        pos - (IPos)max_dist() : 0;
+
+    if(max_len < min_match)
         return 0;
 
-    zs.avail_in  -= len;
-
-    std::memcpy(buf, zs.next_in, len);
-///DYN
-    if(wrap_ == boost::deflate::wrap::zlib){;
-///~DYN
-///ZLIB|DYN
-        zs.check = adler32(buf, len, zs.check);
-///~ZLIB|DYN
-///DYN
-    } else if(wrap_ == boost::deflate::wrap::gzip) {
-///~DYN
-///GZIP|DYN
-        zs.check = crc32(buf, len, zs.check);
-///~GZIP|DYN
-///DYN
-    }
-///~DYN
-    zs.next_in = static_cast<
-        std::uint8_t const*>(zs.next_in) + len;
-    zs.total_in += len;
-    return (int)len;
-}
-
-/*  Set match_start to the longest match starting at the given string and
-    return its length. Matches shorter or equal to prev_length are discarded,
-    in which case the result is equal to prev_length and match_start is
-    garbage.
-    IN assertions: cur_match is the head of the hash chain for the current
-        string (strstart) and its distance is <= max_dist, and prev_length >= 1
-    OUT assertion: the match length is not greater than s->lookahead_.
-
-    For 80x86 and 680x0, an optimized version will be provided in match.asm or
-    match.S. The code will be functionally equivalent.
-*/
-uInt
-deflate_stream::
-longest_match(IPos cur_match)
-{
-    unsigned chain_length = max_chain_length_;/* max hash chain length */
-    Byte *scan = window_ + strstart_; /* current string */
-    Byte *match;                       /* matched string */
-    int len;                           /* length of current match */
-    int best_len = prev_length_;              /* best match length so far */
-    int nice_match = nice_match_;             /* stop if match long enough */
-    IPos limit = strstart_ > (IPos)max_dist() ?
-        strstart_ - (IPos)max_dist() : 0;
-    /* Stop when cur_match becomes <= limit. To simplify the code,
-     * we prevent matches with the string of window index 0.
-     */
-    std::uint16_t *prev = prev_;
-    uInt wmask = w_mask_;
-
-    Byte *strend = window_ + strstart_ + max_match;
-    Byte scan_end1  = scan[best_len-1];
-    Byte scan_end   = scan[best_len];
-
-    /* The code is optimized for HASH_BITS >= 8 and max_match-2 multiple of 16.
-     * It is easy to get rid of this optimization if necessary.
-     */
-    BOOST_ASSERT(hash_bits_ >= 8 && max_match == 258);
-
-    /* Do not waste too much time if we already have a good match: */
-    if(prev_length_ >= good_match_) {
-        chain_length >>= 2;
-    }
-    /* Do not look for matches beyond the end of the input. This is necessary
-     * to make deflate deterministic.
-     */
-    if((uInt)nice_match > lookahead_)
-        nice_match = lookahead_;
-
-    BOOST_ASSERT((std::uint32_t)strstart_ <= window_size_ - kmin_lookahead);
-
+    std::size_t links = 0;
     do {
-        BOOST_ASSERT(cur_match < strstart_);
-        match = window_ + cur_match;
-
-        /* Skip to next match if the match length cannot increase
-         * or if the match length is less than 2.  Note that the checks below
-         * for insufficient lookahead only occur occasionally for performance
-         * reasons.  Therefore uninitialized memory will be accessed, and
-         * conditional jumps will be made that depend on those values.
-         * However the length of the match is limited to the lookahead, so
-         * the output of deflate is not affected by the uninitialized values.
-         */
-        if(     match[best_len]   != scan_end  ||
-                match[best_len-1] != scan_end1 ||
-                *match            != *scan     ||
-                *++match          != scan[1])
-            continue;
-
-        /* The check at best_len-1 can be removed because it will be made
-         * again later. (This heuristic is not always a win.)
-         * It is not necessary to compare scan[2] and match[2] since they
-         * are always equal when the other bytes match, given that
-         * the hash keys are equal and that HASH_BITS >= 8.
-         */
-        scan += 2, match++;
-        BOOST_ASSERT(*scan == *match);
+        BOOST_ASSERT(cur_match < pos);
+        Byte const* match = window_ + cur_match;
+        ++links;
 
-        /* We check for insufficient lookahead only every 8th comparison;
-         * the 256th check will be made at strstart+258.
-         */
-        do
-        {
-        }
-        while(  *++scan == *++match && *++scan == *++match &&
-                *++scan == *++match && *++scan == *++match &&
-                *++scan == *++match && *++scan == *++match &&
-                *++scan == *++match && *++scan == *++match &&
-                scan < strend);
-
-        BOOST_ASSERT(scan <= window_+(unsigned)(window_size_-1));
+        if(     match[best_len] != scan[best_len] ||
+                match[0]        != scan[0]        ||
+                match[1]        != scan[1])
+            continue;
 
-        len = max_match - (int)(strend - scan);
-        scan = strend - max_match;
+        uInt const len = 2 + static_cast<uInt>(match_length(
+            scan + 2, match + 2, max_len - 2));
 
         if(len > best_len) {
-            match_start_ = cur_match;
             best_len = len;
+            matches.push_back({
+                static_cast<std::uint16_t>(len),
+                static_cast<std::uint16_t>(pos - cur_match)});
             if(len >= nice_match) break;
-            scan_end1  = scan[best_len-1];
-            scan_end   = scan[best_len];
         }
     }
-    while((cur_match = prev[cur_match & wmask]) > limit
+    while((cur_match = prev_[cur_match & w_mask_]) > limit
         && --chain_length != 0);
 
-    if((uInt)best_len <= lookahead_)
-        return (uInt)best_len;
-    return lookahead_;
-}
+    count_search(links);
 
-//------------------------------------------------------------------------------
+    return best_len >= min_match ? best_len : 0;
+}
 
-/*  Copy without compression as much as possible from the input stream, return
-    the current block state.
-    This function does not insert new strings in the dictionary since
-    uncompressible data is probably not useful. This function is used
-    only for the level=0 compression option.
-    NOTE: this function should be optimized to avoid extra copying from
-    window to pending_buf.
+/*  Insert the string at window index pos in the binary tree of its
+    hash bucket and return the previous root, which is the most recent
+    string with the same hash, or 0. The tree is sorted by the strings
+    at each index, compared up to nice_match bytes, and every node is
+    older than its parent. The new string becomes the root: the search
+    from the old root walks down the path where it belongs, splitting
+    the visited nodes into its left (smaller) and right (greater)
+    subtrees. The longest match is left in bt_len_ and bt_start_, and
+    when collect is set every match which is longer than the ones
+    before it is appended to the candidate list of the optimal parser.
+    The depth of the walk is bounded, when the bound is reached the
+    unvisited subtrees are cut off.
+    A string with fewer than nice_match bytes of input after it, as
+    before a flush, cannot be sorted yet. It is searched for without
+    being inserted.
 */
 auto
 deflate_stream::
-f_stored(z_params& zs, Flush flush) ->
-    block_state
+bt_insert(uInt pos, bool collect) ->
+    IPos
 {
-    /* Stored blocks are limited to 0xffff bytes, pending_buf is limited
-     * to pending_buf_size, and each stored block has a 5 byte header:
-     */
-    std::uint32_t max_block_size = 0xffff;
-    std::uint32_t max_start;
-
-    if(max_block_size > pending_buf_size_ - 5) {
-        max_block_size = pending_buf_size_ - 5;
+    auto const h = hash_string(pos);
+    IPos cur_match = head_[h];
+    IPos const hash_head = cur_match;
+
+    Byte const* scan = window_ + pos;
+    uInt const avail = input_end_ - pos;
+    uInt const max_len = avail < max_match ? avail : max_match;
+    bool const insert = max_len >= (uInt)nice_match_;
+    uInt const nice_match = insert ? (uInt)nice_match_ : max_len;
+    IPos limit = pos > (IPos)max_dist() ?
+        pos - (IPos)max_dist() : 0;
+    unsigned depth = 16 + max_chain_length_ / 16;
+    if((uInt)nice_match_ < bt_nice_)
+        bt_nice_ = nice_match_;
+
+    std::uint16_t* left = &prev_[2*(pos & w_mask_)];
+    std::uint16_t* right = left + 1;
+    if(insert)
+        head_[h] = (std::uint16_t)pos;
+    uInt left_len = 0;      /* common prefix with the strings on the left */
+    uInt right_len = 0;     /* common prefix with the strings on the right */
+    uInt best_len = min_match - 1;
+
+    std::size_t links = 0;
+    for(;;)
+    {
+        if(cur_match <= limit || depth-- == 0)
+        {
+            if(insert)
+            {
+                *left = 0;
+                *right = 0;
+            }
+            break;
+        }
+        BOOST_ASSERT(cur_match < pos);
+        Byte const* match = window_ + cur_match;
+        std::uint16_t* node = &prev_[2*(cur_match & w_mask_)];
+        ++links;
+
+        /* Both strings share the shorter of the prefixes common with
+         * the nodes on either side of the path, as far as the tree
+         * is sorted.
+         */
+        uInt len = left_len < right_len ? left_len : right_len;
+        if(len > bt_nice_)
+            len = bt_nice_;
+        len += static_cast<uInt>(match_length(
+            scan + len, match + len, nice_match - len));
+        bool const equal = len >= nice_match;
+        if(equal)
+            len += static_cast<uInt>(match_length(
+                scan + len, match + len, max_len - len));
+
+        if(len > best_len)
+        {
+            best_len = len;
+            bt_start_ = cur_match;
+            if(collect)
+                opt_->matches.push_back({
+                    static_cast<std::uint16_t>(len),
+                    static_cast<std::uint16_t>(pos - cur_match)});
+        }
+        if(equal)
+        {
+            /* The strings are equal as far as the tree compares them,
+             * the new string replaces the old one. The match is still
+             * extended to its full length.
+             */
+            if(insert)
+            {
+                *left = node[0];
+                *right = node[1];
+            }
+            break;
+        }
+        if(match[len] < scan[len])
+        {
+            if(insert)
+            {
+                *left = (std::uint16_t)cur_match;
+                left = node + 1;
+            }
+            left_len = len;
+            cur_match = node[1];
+        }
+        else
+        {
+            if(insert)
+            {
+                *right = (std::uint16_t)cur_match;
+                right = node;
+            }
+            right_len = len;
+            cur_match = node[0];
+        }
     }
 
-    /* Copy as much as possible from input to output: */
-    for(;;) {
-        /* Fill the window as much as possible: */
-        if(lookahead_ <= 1) {
+    bt_len_ = best_len >= min_match ? best_len : 0;
 
-            BOOST_ASSERT(strstart_ < w_size_+max_dist() ||
-                   block_start_ >= (long)w_size_);
+    count_search(links);
 
-            fill_window(zs);
-            if(lookahead_ == 0 && flush == Flush::none)
-                return need_more;
+    return hash_head;
+}
 
-            if(lookahead_ == 0) break; /* flush the current block */
-        }
-        BOOST_ASSERT(block_start_ >= 0L);
+/*  Set the costs of the optimal parser to the code lengths of the
+    static trees, for when there are no statistics yet.
+*/
+void
+deflate_stream::
+set_fixed_costs()
+{
+    auto& o = *opt_;
+    for(int n = 0; n < literals; ++n)
+        o.lit_cost[n] = n < 144 ? 8.f : 9.f;
+    for(int len = min_match; len <= max_match; ++len)
+    {
+        int const code = lut_.length_code[len - min_match];
+        o.len_cost[len] = lut_.ltree[code + literals + 1].dl +
+            lut_.extra_lbits[code];
+    }
+    for(int code = 0; code < dcodes; ++code)
+        o.dist_cost[code] = 5.f + lut_.extra_dbits[code];
+}
 
-        strstart_ += lookahead_;
-        lookahead_ = 0;
+/*  Set the costs of the optimal parser from symbol frequencies,
+    charging each symbol its entropy under those frequencies, and
+    return the estimated size in bits of a block with them.
+*/
+float
+deflate_stream::
+set_costs(std::uint32_t const* lfreq, std::uint32_t const* dfreq)
+{
+    auto& o = *opt_;
+    float sym_cost[lcodes];
+    float dsym_cost[dcodes];
 
-        /* Emit a stored block if pending_buf will be full: */
-        max_start = block_start_ + max_block_size;
-        if(strstart_ == 0 || (std::uint32_t)strstart_ >= max_start) {
-            /* strstart == 0 is possible when wraparound on 16-bit machine */
-            lookahead_ = (uInt)(strstart_ - max_start);
-            strstart_ = (uInt)max_start;
-            flush_block(zs, false);
-            if(zs.avail_out == 0)
-                return need_more;
-        }
-        /* Flush if we may have to slide, otherwise block_start may become
-         * negative and the data will be gone:
-         */
-        if(strstart_ - (uInt)block_start_ >= max_dist()) {
-            flush_block(zs, false);
-            if(zs.avail_out == 0)
-                return need_more;
-        }
+    // A symbol which was not seen is charged as if it was seen once
+    auto const entropy =
+        [](std::uint32_t const* freq, int n, float* cost)
+        {
+            std::uint32_t total = 0;
+            for(int i = 0; i < n; ++i)
+                total += freq[i];
+            float const log_total = total != 0 ?
+                std::log2(static_cast<float>(total)) :
+                std::log2(static_cast<float>(n));
+            float bits = 0;
+            for(int i = 0; i < n; ++i)
+            {
+                cost[i] = freq[i] > 1 ? log_total -
+                    std::log2(static_cast<float>(freq[i])) : log_total;
+                bits += freq[i] * cost[i];
+            }
+            return bits;
+        };
+    float bits =
+        entropy(lfreq, lcodes, sym_cost) +
+        entropy(dfreq, dcodes, dsym_cost);
+
+    for(int n = 0; n < literals; ++n)
+        o.lit_cost[n] = sym_cost[n];
+    for(int len = min_match; len <= max_match; ++len)
+    {
+        int const code = lut_.length_code[len - min_match];
+        o.len_cost[len] = sym_cost[code + literals + 1] +
+            lut_.extra_lbits[code];
     }
-    insert_ = 0;
-    if(flush == Flush::finish)
+    for(int code = 0; code < length_codes; ++code)
+        bits += lfreq[code + literals + 1] * lut_.extra_lbits[code];
+    for(int code = 0; code < dcodes; ++code)
     {
-        flush_block(zs, true);
-        if(zs.avail_out == 0)
-            return finish_started;
-        return finish_done;
+        o.dist_cost[code] = dsym_cost[code] + lut_.extra_dbits[code];
+        bits += dfreq[code] * lut_.extra_dbits[code];
     }
-    if((long)strstart_ > block_start_)
+    return bits;
+}
+
+/*  Find the cheapest parse of the size bytes at strstart under the
+    current costs, using the candidate matches of each position, and
+    store it in the path of the optimal parser.
+*/
+void
+deflate_stream::
+optimal_parse(uInt size)
+{
+    auto& o = *opt_;
+    Byte const* const base = window_ + strstart_;
+
+    o.cost[0] = 0;
+    for(uInt i = 1; i <= size; ++i)
+        o.cost[i] = (std::numeric_limits<float>::max)();
+
+    for(uInt i = 0; i < size; ++i)
     {
-        flush_block(zs, false);
-        if(zs.avail_out == 0)
-            return need_more;
+        float const c = o.cost[i];
+        float const lit = c + o.lit_cost[base[i]];
+        if(lit < o.cost[i + 1])
+        {
+            o.cost[i + 1] = lit;
+            o.from[i + 1] = {1, 0};
+        }
+
+        // Each length is tried with the closest match reaching it
+        uInt len = min_match;
+        for(auto k = o.first[i]; k < o.first[i + 1]; ++k)
+        {
+            auto const m = o.matches[k];
+            float const dc = c + o.dist_cost[d_code(m.dist - 1)];
+            uInt const end = m.len < size - i ? m.len : size - i;
+            for(; len <= end; ++len)
+            {
+                float const cost = dc + o.len_cost[len];
+                if(cost < o.cost[i + len])
+                {
+                    o.cost[i + len] = cost;
+                    o.from[i + len] = {
+                        static_cast<std::uint16_t>(len), m.dist};
+                }
+            }
+        }
     }
-    return block_done;
+
+    o.path.clear();
+    for(uInt i = size; i > 0; i -= o.from[i].len)
+        o.path.push_back(o.from[i]);
+    std::reverse(o.path.begin(), o.path.end());
 }
 
-/*  Compress as much as possible from the input stream, return the current
-    block state.
-    This function does not perform lazy evaluation of matches and inserts
-    new strings in the dictionary only for unmatched strings or for short
-    matches. It is used only for the fast compression options.
+//------------------------------------------------------------------------------
+
+/*  Medium compression, used by levels 4 to 6 when enabled. Each
+    step finds a single match as deflate_fast does, then finds the
+    match at the position following it before writing it. The start
+    of the second match is moved back over the end of the first as
+    far as the bytes before both agree, which recovers much of what
+    the lazy evaluation of deflate_slow gains for one search per match
+    instead of two. The second match is kept for the next step in
+    match_length_ and match_start_ with match_available_ set, and the
+    strings it covers are already in the dictionary.
 */
 auto
 deflate_stream::
-f_fast(z_params& zs, Flush flush) ->
+f_medium(z_params& zs, Flush flush) ->
     block_state
 {
     IPos hash_head;       /* head of the hash chain */
-    bool bflush;           /* set if current block must be flushed */
+    bool bflush;          /* set if current block must be flushed */
 
     for(;;)
     {
@@ -2127,68 +2773,92 @@ f_fast(z_params& zs, Flush flush) ->
             if(lookahead_ == 0)
                 break; /* flush the current block */
         }
+        uInt const end = strstart_ + lookahead_;
 
-        /* Insert the string window[strstart .. strstart+2] in the
-         * dictionary, and set hash_head to the head of the hash chain:
+        /* The match at strstart, a length below min_match is a literal
          */
-        hash_head = 0;
-        if(lookahead_ >= min_match) {
-            insert_string(hash_head);
+        uInt len;
+        IPos start;
+        if(match_available_)
+        {
+            len = match_length_;
+            start = match_start_;
+            match_available_ = 0;
+        }
+        else
+        {
+            hash_head = 0;
+            if(lookahead_ >= min_match)
+                insert_string(hash_head);
+            len = medium_match(hash_head);
+            start = match_start_;
+            medium_insert(strstart_, len, lookahead_);
         }
 
-        /* Find the longest match, discarding those <= prev_length.
-         * At this point we have always match_length < min_match
+        /* Find the match following this one, and move it back
+         * over the end of this one.
          */
-        if(hash_head != 0 && strstart_ - hash_head <= max_dist()) {
-            /* To simplify the code, we prevent matches with the string
-             * of window index 0 (in particular we have to avoid a match
-             * of the string with itself at the start of the input file).
-             */
-            match_length_ = longest_match (hash_head);
-            /* longest_match() sets match_start */
-        }
-        if(match_length_ >= min_match)
+        if(len < min_match)
+            len = 1;
+        uInt const next = strstart_ + len;
+        if(end - next >= min_match &&
+            next < window_size_ - kmin_lookahead)
         {
-            tr_tally_dist(static_cast<std::uint16_t>(strstart_ - match_start_),
-                          static_cast<std::uint8_t>(match_length_ - min_match), bflush);
-
-            lookahead_ -= match_length_;
+            uInt const cur = strstart_;
+            strstart_ = next;
+            lookahead_ = end - next;
+            insert_string(hash_head);
+            uInt next_len = medium_match(hash_head);
+            strstart_ = cur;
+            lookahead_ = end - cur;
+            medium_insert(next, next_len, end - next);
 
-            /* Insert new strings in the hash table only if the match length
-             * is not too large. This saves time but degrades compression.
-             */
-            if(match_length_ <= max_lazy_match_ &&
-               lookahead_ >= min_match) {
-                match_length_--; /* string at strstart already in table */
-                do
+            uInt back = 0;
+            if(next_len >= min_match)
+            {
+                while(back < len &&
+                    next_len + back < max_match &&
+                    match_start_ > back &&
+                    window_[next - back - 1] ==
+                        window_[match_start_ - back - 1])
+                    ++back;
+
+                /* This match must keep at least min_match
+                 * bytes, unless it is taken over completely.
+                 */
+                if(back < len)
                 {
-                    strstart_++;
-                    insert_string(hash_head);
-                    /* strstart never exceeds WSIZE-max_match, so there are
-                     * always min_match bytes ahead.
-                     */
+                    if(len >= min_match)
+                        back = (std::min)(back, len - min_match);
+                    else
+                        back = 0;
                 }
-                while(--match_length_ != 0);
-                strstart_++;
             }
             else
             {
-                strstart_ += match_length_;
-                match_length_ = 0;
-                ins_h_ = window_[strstart_];
-                update_hash(ins_h_, window_[strstart_+1]);
-                /* If lookahead < min_match, ins_h is garbage, but it does not
-                 * matter since it will be recomputed at next deflate call.
-                 */
+                next_len = 1;
             }
+            len -= back;
+            match_length_ = next_len + back;
+            match_start_ -= back;
+            match_available_ = 1;
         }
-        else
+
+        if(len >= min_match)
+        {
+            tr_tally_dist(static_cast<std::uint16_t>(strstart_ - start),
+                          static_cast<std::uint8_t>(len - min_match), bflush);
+        }
+        else if(len == 1)
         {
-            /* No match, output a literal byte */
             tr_tally_lit(window_[strstart_], bflush);
-            lookahead_--;
-            strstart_++;
         }
+        else
+        {
+            bflush = false;
+        }
+        strstart_ += len;
+        lookahead_ -= len;
         if(bflush)
         {
             flush_block(zs, false);
@@ -2204,7 +2874,7 @@ f_fast(z_params& zs, Flush flush) ->
             return finish_started;
         return finish_done;
     }
-    if(last_lit_)
+    if(sym_next_)
     {
         flush_block(zs, false);
         if(zs.avail_out == 0)
@@ -2213,149 +2883,45 @@ f_fast(z_params& zs, Flush flush) ->
     return block_done;
 }
 
-/*  Same as above, but achieves better compression. We use a lazy
-    evaluation for matches: a match is finally adopted only if there is
-    no better match at the next window position.
+/*  Return the length of the longest match at strstart for the medium
+    compressor, or a length below min_match if there is no match worth
+    taking, and set match_start_.
 */
-auto
+uInt
 deflate_stream::
-f_slow(z_params& zs, Flush flush) ->
-    block_state
+medium_match(IPos hash_head)
 {
-    IPos hash_head;          /* head of hash chain */
-    bool bflush;              /* set if current block must be flushed */
-
-    /* Process the input block. */
-    for(;;)
-    {
-        /* Make sure that we always have enough lookahead, except
-         * at the end of the input file. We need max_match bytes
-         * for the next match, plus min_match bytes to insert the
-         * string following the next match.
-         */
-        if(lookahead_ < kmin_lookahead)
-        {
-            fill_window(zs);
-            if(lookahead_ < kmin_lookahead && flush == Flush::none)
-                return need_more;
-            if(lookahead_ == 0)
-                break; /* flush the current block */
-        }
-
-        /* Insert the string window[strstart .. strstart+2] in the
-         * dictionary, and set hash_head to the head of the hash chain:
-         */
-        hash_head = 0;
-        if(lookahead_ >= min_match)
-            insert_string(hash_head);
-
-        /* Find the longest match, discarding those <= prev_length.
-         */
-        prev_length_ = match_length_, prev_match_ = match_start_;
-        match_length_ = min_match - 1;
-
-        if(hash_head != 0 && prev_length_ < max_lazy_match_ &&
-            strstart_ - hash_head <= max_dist())
-        {
-            /* To simplify the code, we prevent matches with the string
-             * of window index 0 (in particular we have to avoid a match
-             * of the string with itself at the start of the input file).
-             */
-            match_length_ = longest_match(hash_head);
-            /* longest_match() sets match_start */
-
-            if(match_length_ <= 5 && (strategy_ == Strategy::filtered
-                || (match_length_ == min_match &&
-                    strstart_ - match_start_ > ktoo_far)
-                ))
-            {
-                /* If prev_match is also min_match, match_start is garbage
-                 * but we will ignore the current match anyway.
-                 */
-                match_length_ = min_match - 1;
-            }
-        }
-        /* If there was a match at the previous step and the current
-         * match is not better, output the previous match:
-         */
-        if(prev_length_ >= min_match && match_length_ <= prev_length_)
-        {
-            /* Do not insert strings in hash table beyond this. */
-            uInt max_insert = strstart_ + lookahead_ - min_match;
-
-            tr_tally_dist(
-                static_cast<std::uint16_t>(strstart_ -1 - prev_match_),
-                static_cast<std::uint8_t>(prev_length_ - min_match), bflush);
-
-            /* Insert in hash table all strings up to the end of the match.
-             * strstart-1 and strstart are already inserted. If there is not
-             * enough lookahead, the last two strings are not inserted in
-             * the hash table.
-             */
-            lookahead_ -= prev_length_-1;
-            prev_length_ -= 2;
-            do {
-                if(++strstart_ <= max_insert)
-                    insert_string(hash_head);
-            }
-            while(--prev_length_ != 0);
-            match_available_ = 0;
-            match_length_ = min_match - 1;
-            strstart_++;
-
-            if(bflush)
-            {
-                flush_block(zs, false);
-                if(zs.avail_out == 0)
-                    return need_more;
-            }
+    if(hash_head == 0 || strstart_ - hash_head > max_dist())
+        return 0;
+    prev_length_ = min_match - 1;
+    uInt const len = longest_match(hash_head);
+    if(len <= 5 && (strategy_ == Strategy::filtered
+        || (len == min_match && strstart_ - match_start_ > ktoo_far)))
+        return 0;
+    return len;
+}
 
-        }
-        else if(match_available_)
-        {
-            /* If there was no match at the previous position, output a
-             * single literal. If there was a match but the current match
-             * is longer, truncate the previous match to a single literal.
-             */
-            tr_tally_lit(window_[strstart_-1], bflush);
-            if(bflush)
-                flush_block(zs, false);
-            strstart_++;
-            lookahead_--;
-            if(zs.avail_out == 0)
-                return need_more;
-        }
-        else
-        {
-            /* There is no previous match to compare with, wait for
-             * the next step to decide.
-             */
-            match_available_ = 1;
-            strstart_++;
-            lookahead_--;
-        }
-    }
-    BOOST_ASSERT(flush != Flush::none);
-    if(match_available_)
-    {
-        tr_tally_lit(window_[strstart_-1], bflush);
-        match_available_ = 0;
-    }
-    insert_ = strstart_ < min_match - 1 ? strstart_ : min_match - 1;
-    if(flush == Flush::finish)
+/*  Insert the strings of a match at window index str after the first,
+    which is already in the dictionary. As in deflate_fast, the strings
+    of long matches are not inserted to save time. avail is the number
+    of bytes of input from str.
+*/
+void
+deflate_stream::
+medium_insert(uInt str, uInt len, uInt avail)
+{
+    if(len < min_match)
+        return;
+    if(len <= 16 * max_lazy_match_ && avail - len >= min_match)
     {
-        flush_block(zs, true);
-        if(zs.avail_out == 0)
-            return finish_started;
-        return finish_done;
+        for(uInt i = 1; i < len; ++i)
+            insert_string_at(str + i);
     }
-    if(last_lit_)
+    else
     {
-        flush_block(zs, false);
-        if(zs.avail_out == 0)
-            return need_more;
+        ins_h_ = window_[str + len];
+        update_hash(ins_h_, window_[str + len + 1]);
     }
-    return block_done;
 }
 
 /*  For Strategy::rle, simply look for runs of bytes, generate matches only of distance
@@ -2435,7 +3001,7 @@ f_rle(z_params& zs, Flush flush) ->
             return finish_started;
         return finish_done;
     }
-    if(last_lit_)
+    if(sym_next_)
     {
         flush_block(zs, false);
         if(zs.avail_out == 0)
@@ -2489,7 +3055,539 @@ f_huff(z_params& zs, Flush flush) ->
             return finish_started;
         return finish_done;
     }
-    if(last_lit_)
+    if(sym_next_)
+    {
+        flush_block(zs, false);
+        if(zs.avail_out == 0)
+            return need_more;
+    }
+    return block_done;
+}
+
+/*  Choose the engine for the n bytes at p. Runs of bytes go to the
+    rle engine. Bytes with almost no repeated strings of four bytes
+    go to the Huffman engine, or are stored when the entropy of the
+    bytes leaves nothing to gain, and anything else is compressed at
+    the level. Strategies other than Strategy::adaptive only choose
+    between storing and the level. Longer input is judged by a sample at each end, and a
+    chunk whose ends disagree is compressed at the level.
+*/
+auto
+deflate_stream::
+adaptive_choice(Byte const* p, std::size_t n) const ->
+    compress_func
+{
+    if(level_ == 0 || n < min_match + 1)
+        return level_func(level_);
+    if(n > 2 * adaptive_sample)
+    {
+        auto const head = adaptive_choice(p, adaptive_sample);
+        if(head != adaptive_choice(
+                p + n - adaptive_sample, adaptive_sample))
+            return level_func(level_);
+        return head;
+    }
+
+    std::uint32_t freq[256] = {};
+    std::uint16_t seen[4096] = {};  // 1 + last position of each hash
+    std::size_t runs = 0;
+    std::size_t repeats = 0;
+    ++freq[p[0]];
+    for(std::size_t i = 1; i < n; ++i)
+    {
+        ++freq[p[i]];
+        if(p[i] == p[i - 1])
+            ++runs;
+    }
+    for(std::size_t i = 0; i + 4 <= n; ++i)
+    {
+        auto const h = (read_u32(p + i) * 2654435761U) >> 20;
+        auto const j = seen[h];
+        if(j != 0 && read_u32(p + j - 1) == read_u32(p + i))
+            ++repeats;
+        seen[h] = static_cast<std::uint16_t>(i + 1);
+    }
+
+    bool const adaptive = strategy_ == Strategy::adaptive;
+    if(adaptive && 4 * runs >= 3 * n)
+        return &self::deflate_rle;
+    if(256 * repeats >= n)
+        return level_func(level_);
+
+    // Bits per byte of the sample with ideal codes
+    double sum = 0;
+    for(auto f : freq)
+        if(f != 0)
+            sum += f * std::log2(static_cast<double>(f));
+    double const bits = std::log2(static_cast<double>(n)) - sum / n;
+    if(bits >= 7.9)
+        return &self::deflate_stored;
+    if(adaptive)
+        return &self::deflate_huff;
+    return level_func(level_);
+}
+
+/*  Bring the hash table up to date with the window after f_stored
+    moved it: slide the table once, or clear it when the whole window
+    was replaced.
+*/
+void
+deflate_stream::
+catch_up_hash()
+{
+    if(stale_hash_ == 1)
+    {
+        auto const wsize = static_cast<std::uint16_t>(w_size_);
+        slide_hash(head_, hash_size_, wsize);
+        slide_hash(prev_, tree_ ? 2 * w_size_ : w_size_, wsize);
+    }
+    else if(stale_hash_ == 2)
+    {
+        clear_hash();
+    }
+    stale_hash_ = 0;
+}
+
+/*  Move long positions by slide window bytes. When the base of the
+    positions reaches long_rebase, which happens once every two gigabytes
+    of input, the hash chains are rebased to the window instead, and
+    positions below the window become 0, the end of a chain.
+*/
+void
+deflate_stream::
+slide_positions(uInt slide)
+{
+    BOOST_ASSERT(wide_ && (slide & w_mask_) == 0);
+    base_ += slide;
+    if(base_ < long_rebase)
+        return;
+    slide_hash(head<long_params>(), hash_size_, base_);
+    slide_hash(prev<long_params>(), w_size_, base_);
+    base_ = 0;
+}
+
+// Whether the engine of a level and strategy supports long positions
+bool
+deflate_stream::
+keeps_positions(int level, Strategy strategy) const
+{
+    auto const func = level_func(level);
+    return strategy != Strategy::quick &&
+        func != &self::deflate_medium &&
+        func != &self::deflate_optimal;
+}
+
+/*  For Strategy::adaptive, compress each chunk of adaptive_chunk input
+    bytes with the engine chosen from a sample of its first bytes. When
+    the choice changes, the block of the previous engine is ended and
+    the lazy match state is cleared before the next engine starts, and
+    the hash of the window bytes is primed again for an engine which
+    uses it.
+*/
+auto
+deflate_stream::
+f_adaptive(z_params& zs, Flush flush) ->
+    block_state
+{
+    for(;;)
+    {
+        if(adaptive_left_ == 0 && (zs.avail_in != 0 || ! adaptive_func_))
+        {
+            auto const func = zs.avail_in == 0 ? level_func(level_) :
+                adaptive_choice(static_cast<Byte const*>(zs.next_in),
+                    (std::min)(zs.avail_in, std::size_t{adaptive_chunk}));
+            if(adaptive_func_ && func != adaptive_func_)
+            {
+                auto const avail = zs.avail_in;
+                zs.avail_in = 0;
+                auto const bstate = (this->*adaptive_func_)(zs, Flush::block);
+                zs.avail_in = avail;
+                if(bstate != block_done)
+                    return need_more;
+                match_length_ = prev_length_ = min_match - 1;
+                match_available_ = 0;
+                insert_ = strstart_ < min_match - 1 ?
+                    strstart_ : min_match - 1;
+                catch_up_hash();
+            }
+            adaptive_func_ = func;
+            adaptive_left_ = adaptive_chunk;
+            store_ = func == &self::deflate_stored;
+        }
+
+        // The last piece of the input is compressed with the caller's flush
+        auto const avail = zs.avail_in;
+        auto const n = (std::min)(avail, adaptive_left_);
+        bool const last = n == avail;
+        zs.avail_in = n;
+        auto const bstate = (this->*adaptive_func_)(
+            zs, last ? flush : Flush::none);
+        auto const used = n - zs.avail_in;
+        zs.avail_in = avail - used;
+        adaptive_left_ -= used;
+        if(last || bstate != need_more || zs.avail_out == 0)
+            return bstate;
+    }
+}
+
+/* ===========================================================================
+ * For Strategy::quick, probe a single hash table entry per position and
+ * write each literal or match directly with the static trees, without
+ * tallying symbols. The table holds only the most recent string for each
+ * hash of four bytes, there are no chains. A static block is kept open
+ * across calls until the caller flushes.
+ */
+auto
+deflate_stream::
+f_quick(z_params& zs, Flush flush) ->
+    block_state
+{
+    bool const last = flush == Flush::finish;
+
+    // Symbols tallied by another strategy are written first
+    if(sym_next_)
+    {
+        flush_block(zs, false);
+        if(zs.avail_out == 0)
+            return need_more;
+    }
+    if(pending_ + 2 * sizeof(bi_buf_) > pending_buf_size_)
+    {
+        flush_pending(zs);
+        if(zs.avail_out == 0)
+            return need_more;
+    }
+
+    if(last && block_open_ != 2)
+    {
+        if(! quick_end_block(zs, false))
+            return need_more;
+        quick_start_block(true);
+    }
+    else if(block_open_ == 0 && lookahead_ > 0)
+    {
+        quick_start_block(false);
+    }
+
+    for(;;)
+    {
+        if(lookahead_ < kmin_lookahead)
+        {
+            fill_window(zs);
+            if(lookahead_ < kmin_lookahead && flush == Flush::none)
+                return need_more;
+            if(lookahead_ == 0)
+                break; /* end the current block */
+
+            /* Start a block only once there is input, so that no
+             * empty blocks are written.
+             */
+            if(block_open_ == 0)
+                quick_start_block(last);
+        }
+
+        /* A symbol takes at most 31 bits and covers at least one
+         * position, so the positions before stop can be written
+         * without checking for room in the pending buffer. Unless
+         * flushing, kmin_lookahead bytes are kept ahead of each.
+         */
+        if(pending_ + 2 * sizeof(bi_buf_) + 4 > pending_buf_size_)
+        {
+            flush_pending(zs);
+            if(zs.avail_out == 0)
+                return need_more;
+        }
+        uInt const end = strstart_ + lookahead_;
+        uInt stop = flush == Flush::none ?
+            end - (kmin_lookahead - 1) : end;
+        std::size_t const room = (pending_buf_size_ - pending_ -
+            2 * sizeof(bi_buf_)) / 4;
+        if(stop - strstart_ > room)
+            stop = strstart_ + static_cast<uInt>(room);
+
+        bit_cursor bc{bi_buf_, bi_valid_, pending_buf_ + pending_};
+        uInt str = strstart_;
+        std::size_t searches = 0;
+        std::size_t links = 0;
+        while(str < stop)
+        {
+            uInt const avail = end - str;
+            if(avail >= quick_min_match)
+            {
+                Byte const* scan = window_ + str;
+                auto const h = hash_multiplicative(scan);
+                IPos const hash_head = head_[h];
+                head_[h] = (std::uint16_t)str;
+                ++searches;
+
+                // A head at or past str is left from other tables
+                unsigned const dist = str - hash_head;
+                Byte const* match = window_ + hash_head;
+                if(hash_head != 0 && hash_head < str &&
+                    dist <= max_dist() &&
+                    read_u32(scan) == read_u32(match))
+                {
+                    ++links;
+                    uInt const max_len =
+                        avail < max_match ? avail : max_match;
+                    uInt const len = quick_min_match +
+                        static_cast<uInt>(match_length(
+                            scan + quick_min_match, match + quick_min_match,
+                            max_len - quick_min_match));
+
+                    int lc = len - min_match;
+                    unsigned code = lut_.length_code[lc];
+                    bc.send_code(code + literals + 1, lut_.ltree);
+                    int extra = lut_.extra_lbits[code];
+                    if(extra != 0)
+                        bc.send_bits(lc - lut_.base_length[code], extra);
+                    unsigned d = dist - 1;
+                    code = d_code(d);
+                    bc.send_code(code, lut_.dtree);
+                    extra = lut_.extra_dbits[code];
+                    if(extra != 0)
+                        bc.send_bits(d - lut_.base_dist[code], extra);
+                    str += len;
+                    continue;
+                }
+            }
+            bc.send_code(window_[str], lut_.ltree);
+            ++str;
+        }
+        bi_buf_ = bc.buf;
+        bi_valid_ = bc.valid;
+        pending_ = static_cast<uInt>(bc.out - pending_buf_);
+        strstart_ = str;
+        lookahead_ = end - str;
+
+#ifndef BOOST_DEFLATE_NO_MATCH_STATS
+        stats_.searches += searches;
+        stats_.chain_links += links;
+        if(links > 0 && stats_.max_chain < 1)
+            stats_.max_chain = 1;
+#else
+        (void)searches;
+        (void)links;
+#endif
+    }
+    insert_ = strstart_ < min_match - 1 ? strstart_ : min_match - 1;
+    if(last)
+    {
+        if(! quick_end_block(zs, true))
+            return finish_started;
+        return finish_done;
+    }
+    if(! quick_end_block(zs, false))
+        return need_more;
+    return block_done;
+}
+
+/*  Start a block with static trees for the quick strategy.
+*/
+void
+deflate_stream::
+quick_start_block(bool last)
+{
+    ++stats_.static_blocks;
+    send_bits((static_trees << 1) + last, 3);
+    block_open_ = last ? 2 : 1;
+    block_start_ = strstart_;
+}
+
+/*  End the open block of the quick strategy, if any, and
+    return false if the output buffer is full.
+*/
+bool
+deflate_stream::
+quick_end_block(z_params& zs, bool last)
+{
+    if(block_open_ == 0)
+        return true;
+    send_code(end_block, lut_.ltree);
+    if(last)
+        bi_windup();
+    block_open_ = 0;
+    block_start_ = strstart_;
+    flush_pending(zs);
+    return zs.avail_out != 0;
+}
+
+/*  Levels 10 and up parse the input with a cost model instead of the
+    lazy evaluation of f_slow. The lookahead is split into segments. For
+    each segment the candidate matches of every position are collected
+    once, then the cheapest path through literals and matches is found
+    several times, each time with symbol costs derived from the path
+    before it together with the symbols already in the block. The
+    cheapest of these paths is tallied, and blocks are flushed when the
+    symbol buffer is full, as for the other levels.
+*/
+auto
+deflate_stream::
+f_optimal(z_params& zs, Flush flush) ->
+    block_state
+{
+    auto& o = *opt_;
+    uInt const max_segment = lit_bufsize_ - 1;
+    bool bflush = false;
+
+    if(o.cost.size() < max_segment + 1)
+    {
+        o.first.resize(max_segment + 1);
+        o.cost.resize(max_segment + 1);
+        o.from.resize(max_segment + 1);
+    }
+
+    for(;;)
+    {
+        /* Read ahead as far as the window allows, a segment which
+         * spans more input has more matches to choose from.
+         */
+        if(lookahead_ < max_segment + kmin_lookahead)
+        {
+            uInt n;
+            do
+            {
+                n = lookahead_;
+                fill_window(zs);
+            }
+            while(lookahead_ != n && zs.avail_in != 0 &&
+                lookahead_ < max_segment + kmin_lookahead);
+            if(lookahead_ < max_segment + kmin_lookahead &&
+                    zs.avail_in == 0 && flush == Flush::none)
+                return need_more;
+            if(lookahead_ == 0)
+                break; /* flush the current block */
+        }
+
+        /* Unless flushing, keep max_match bytes of lookahead so that
+         * every match in the segment is found at its full length. The
+         * whole segment must fit in the symbol buffer.
+         */
+        uInt size = lookahead_;
+        if(flush == Flush::none)
+            size -= max_match;
+        if(size > max_segment - sym_next_ / 3)
+            size = max_segment - sym_next_ / 3;
+
+        /* Insert every position of the segment in the dictionary and
+         * collect its matches. The positions covered by a match of
+         * nice length are inserted without a search.
+         */
+        o.matches.clear();
+        uInt skip = 0;
+        for(uInt i = 0; i < size; ++i)
+        {
+            uInt const pos = strstart_ + i;
+            uInt const avail = lookahead_ - i;
+            o.first[i] = static_cast<std::uint32_t>(o.matches.size());
+            IPos hash_head = 0;
+            if(tree_)
+            {
+                if(avail < min_match)
+                    continue;
+                bt_insert(pos, skip == 0);
+                if(skip > 0)
+                    --skip;
+                else if(bt_len_ >= (uInt)nice_match_)
+                    skip = bt_len_ - 1;
+                continue;
+            }
+            if(avail >= min_match)
+                hash_head = insert_string_at(pos);
+            if(skip > 0)
+            {
+                --skip;
+                continue;
+            }
+            if(hash_head != 0 && pos - hash_head <= max_dist())
+            {
+                auto const len = find_matches(pos, hash_head, avail);
+                if(len >= (uInt)nice_match_)
+                    skip = len - 1;
+            }
+        }
+        o.first[size] = static_cast<std::uint32_t>(o.matches.size());
+
+        /* Refine the cost model, starting from the symbols already in
+         * the block, or from the static trees for a new block.
+         */
+        std::uint32_t lfreq[lcodes];
+        std::uint32_t dfreq[dcodes];
+        float best_cost = (std::numeric_limits<float>::max)();
+        int const iterations = strategy_ == Strategy::fixed ?
+            1 : optimal_iterations(level_);
+        if(strategy_ == Strategy::fixed || sym_next_ == 0)
+        {
+            set_fixed_costs();
+        }
+        else
+        {
+            for(int n = 0; n < lcodes; ++n)
+                lfreq[n] = dyn_ltree_[n].fc;
+            for(int n = 0; n < dcodes; ++n)
+                dfreq[n] = dyn_dtree_[n].fc;
+            set_costs(lfreq, dfreq);
+        }
+        for(int iteration = 0; iteration < iterations; ++iteration)
+        {
+            optimal_parse(size);
+            for(int n = 0; n < lcodes; ++n)
+                lfreq[n] = dyn_ltree_[n].fc;
+            for(int n = 0; n < dcodes; ++n)
+                dfreq[n] = dyn_dtree_[n].fc;
+            uInt pos = strstart_;
+            for(auto const& step : o.path)
+            {
+                if(step.dist == 0)
+                {
+                    ++lfreq[window_[pos]];
+                }
+                else
+                {
+                    ++lfreq[lut_.length_code[step.len - min_match] +
+                        literals + 1];
+                    ++dfreq[d_code(step.dist - 1)];
+                }
+                pos += step.len;
+            }
+            auto const cost = set_costs(lfreq, dfreq);
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                o.best.swap(o.path);
+            }
+        }
+
+        // A block split may be requested before the last step
+        bool end = false;
+        for(auto const& step : o.best)
+        {
+            if(step.dist == 0)
+                tr_tally_lit(window_[strstart_], bflush);
+            else
+                tr_tally_dist(step.dist,
+                    static_cast<std::uint8_t>(step.len - min_match), bflush);
+            end = end || bflush;
+            strstart_ += step.len;
+            lookahead_ -= step.len;
+        }
+        if(end)
+        {
+            flush_block(zs, false);
+            if(zs.avail_out == 0)
+                return need_more;
+        }
+    }
+    BOOST_ASSERT(flush != Flush::none);
+    insert_ = strstart_ < min_match - 1 ? strstart_ : min_match - 1;
+    if(flush == Flush::finish)
+    {
+        flush_block(zs, true);
+        if(zs.avail_out == 0)
+            return finish_started;
+        return finish_done;
+    }
+    if(sym_next_)
     {
         flush_block(zs, false);
         if(zs.avail_out == 0)
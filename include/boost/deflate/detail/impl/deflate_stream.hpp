@@ -0,0 +1,835 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+// Copyright (c) 2016-2020 Vinnie Falco (vinnie dot falco at gmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+// This is a derivative work based on Zlib, copyright below:
+/*
+    Copyright (C) 1995-2013 Jean-loup Gailly and Mark Adler
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would be
+       appreciated but is not required.
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+    3. This notice may not be removed or altered from any source distribution.
+
+    Jean-loup Gailly        Mark Adler
+    jloup@gzip.org          madler@alumni.caltech.edu
+
+    The data format used by the zlib library is described by RFCs (Request for
+    Comments) 1950 to 1952 in the files http://tools.ietf.org/html/rfc1950
+    (zlib format), rfc1951 (deflate format) and rfc1952 (gzip format).
+*/
+
+#ifndef BOOST_DEFLATE_DETAIL_IMPL_DEFLATE_STREAM_HPP
+#define BOOST_DEFLATE_DETAIL_IMPL_DEFLATE_STREAM_HPP
+
+#include <boost/deflate/detail/adler.hpp>
+#include <boost/deflate/detail/crc.hpp>
+#include <boost/deflate/detail/match_length.hpp>
+#include <boost/deflate/detail/ranges.hpp>
+#include <boost/deflate/detail/slide_hash.hpp>
+#include <boost/assert.hpp>
+#include <cstdint>
+#include <cstring>
+
+namespace boost {
+namespace deflate {
+namespace detail {
+
+/*  These are the parts of the compressor which run for every byte
+    of input. They are templates on the stream parameters known at
+    compile time, see deflate_stream::params, and are instantiated
+    for dynamic_params by the library.
+*/
+
+template<class P>
+void
+deflate_stream::
+fill_window(z_params& zs)
+{
+    unsigned n;
+    unsigned more;    // Amount of free space at the end of the window.
+    uInt wsize = w_size<P>();
+
+    /*  The window slides by half its size, or with long positions
+        by all of it but the last wsize bytes.
+    */
+    uInt const slide = P::wide ? window_size<P>() - wsize : wsize;
+
+    do
+    {
+        more = (unsigned)(window_size<P>() -
+            (std::uint32_t)lookahead_ -(std::uint32_t)strstart_);
+
+        /*  If the window is almost full and there is insufficient lookahead,
+            move the upper half to the lower one to make room in the upper half.
+        */
+        if(strstart_ >= slide+max_dist<P>())
+        {
+            if(! borrowed())
+            {
+                std::memcpy(window_, window_+slide, (unsigned)wsize);
+            }
+            else
+            {
+                window_ += wsize;
+                high_water_ = window_size<P>();
+            }
+            match_start_ -= slide;
+            strstart_    -= slide; // we now have strstart >= max_dist
+            block_start_ -= (long) slide;
+            if(insert_ > strstart_)
+              insert_ = strstart_;
+
+            /* Slide the hash table (could be avoided with 32 bit values
+               at the expense of memory usage). We slide even when level == 0
+               to keep the hash table consistent if we switch back to level > 0
+               later. (Using level 0 permanently is not an optimal usage of
+               zlib, so we don't care about this pathological case.)
+               Long positions are 32 bit values: only their base moves.
+            */
+            if(P::wide)
+            {
+                slide_positions(slide);
+            }
+            else
+            {
+                slide_hash(head_, hash_size_,
+                    static_cast<std::uint16_t>(wsize));
+                /*  If n is not on any hash chain, prev[n] is garbage but
+                    its value will never be used.
+                */
+                slide_hash(prev_, P::dynamic && tree_ ? 2*wsize : wsize,
+                    static_cast<std::uint16_t>(wsize));
+            }
+            more += slide;
+        }
+        if(zs.avail_in == 0)
+            break;
+
+        // Stop short of the end of the caller's buffer
+        if(borrowed() && zs.avail_in < more + borrow_margin)
+            own_window();
+
+        /*  If there was no sliding:
+               strstart <= WSIZE+max_dist-1 && lookahead <= kmin_lookahead - 1 &&
+               more == window_size - lookahead - strstart
+            => more >= window_size - (kmin_lookahead-1 + WSIZE + max_dist-1)
+            => more >= window_size - 2*WSIZE + 2
+            In the BIG_MEM or MMAP case (not yet supported),
+              window_size == input_size + kmin_lookahead  &&
+              strstart + lookahead_ <= input_size => more >= kmin_lookahead.
+            Otherwise, window_size == 2*WSIZE so more >= 2.
+            If there was sliding, more >= WSIZE. So in all cases, more >= 2.
+        */
+        n = read_buf<P>(zs, window_ + strstart_ + lookahead_, more);
+        lookahead_ += n;
+        input_end_ = strstart_ + lookahead_;
+
+        // Initialize the hash value now that we have some input:
+        if(lookahead_ + insert_ >= min_match)
+        {
+            uInt str = strstart_ - insert_;
+            ins_h_ = window_[str];
+            update_hash(ins_h_, window_[str + 1]);
+            while(insert_)
+            {
+                insert_string_at<P>(str);
+                str++;
+                insert_--;
+                if(lookahead_ + insert_ < min_match)
+                    break;
+            }
+        }
+        /*  If the whole input has less than min_match bytes, ins_h is garbage,
+            but this is not important since only literal bytes will be emitted.
+        */
+    }
+    while(lookahead_ < kmin_lookahead && zs.avail_in != 0);
+    input_end_ = strstart_ + lookahead_;
+
+    /*  If the kwin_init bytes after the end of the current data have never been
+        written, then zero those bytes in order to avoid memory check reports of
+        the use of uninitialized (or uninitialised as Julian writes) bytes by
+        the longest match routines.  Update the high water mark for the next
+        time through here.  kwin_init is set to max_match since the longest match
+        routines allow scanning to strstart + max_match, ignoring lookahead.
+    */
+    if(high_water_ < window_size<P>() && ! borrowed())
+    {
+        std::uint32_t curr = strstart_ + (std::uint32_t)(lookahead_);
+        std::uint32_t winit;
+
+        if(high_water_ < curr)
+        {
+            /*  Previous high water mark below current data -- zero kwin_init
+                bytes or up to end of window, whichever is less.
+            */
+            winit = window_size<P>() - curr;
+            if(winit > kwin_init)
+                winit = kwin_init;
+            std::memset(window_ + curr, 0, (unsigned)winit);
+            high_water_ = curr + winit;
+        }
+        else if(high_water_ < (std::uint32_t)curr + kwin_init)
+        {
+            /*  High water mark at or above current data, but below current data
+                plus kwin_init -- zero out to current data plus kwin_init, or up
+                to end of window, whichever is less.
+            */
+            winit = (std::uint32_t)curr + kwin_init - high_water_;
+            if(winit > window_size<P>() - high_water_)
+                winit = window_size<P>() - high_water_;
+            std::memset(window_ + high_water_, 0, (unsigned)winit);
+            high_water_ += winit;
+        }
+    }
+}
+
+/*  Read a new buffer from the current input stream, update the adler32
+    and total number of bytes read.  All write() input goes through
+    this function so some applications may wish to modify it to avoid
+    allocating a large strm->next_in buffer and copying from it.
+    (See also flush_pending()).
+*/
+template<class P>
+int
+deflate_stream::
+read_buf(z_params& zs, Byte *buf, unsigned size)
+{
+    auto len = clamp(zs.avail_in, size);
+    if(len == 0)
+        return 0;
+
+    zs.avail_in  -= len;
+
+    // The window may already be the input, see borrow_window
+    auto const in = static_cast<Byte const*>(zs.next_in);
+    if(buf == in)
+    {
+        if(format<P>() == wrap::zlib)
+            zs.check = adler32(buf, len, zs.check);
+        else if(format<P>() == wrap::gzip)
+            zs.check = crc32(buf, len, zs.check);
+    }
+    else if(format<P>() == wrap::zlib)
+        zs.check = adler32_copy(buf, in, len, zs.check);
+    else if(format<P>() == wrap::gzip)
+        zs.check = crc32_copy(buf, in, len, zs.check);
+    else
+        std::memcpy(buf, in, len);
+    zs.next_in = static_cast<
+        std::uint8_t const*>(zs.next_in) + len;
+    zs.total_in += len;
+    return (int)len;
+}
+
+/*  Set match_start to the longest match starting at the given string and
+    return its length. Matches shorter or equal to prev_length are discarded,
+    in which case the result is equal to prev_length and match_start is
+    garbage.
+    IN assertions: cur_match is the head of the hash chain for the current
+        string (strstart) and its distance is <= max_dist, and prev_length >= 1
+    OUT assertion: the match length is not greater than s->lookahead_.
+
+    Candidate matches are extended with the widest match_length kernel
+    enabled for the build, which gives the same result as comparing
+    one byte at a time.
+*/
+template<class P>
+uInt
+deflate_stream::
+longest_match(IPos cur_match)
+{
+    unsigned chain_length = max_chain_length_;/* max hash chain length */
+    Byte *scan = window_ + strstart_; /* current string */
+    Byte *match;                       /* matched string */
+    int len;                           /* length of current match */
+    int best_len = prev_length_;              /* best match length so far */
+    int nice_match = nice_match_;             /* stop if match long enough */
+    IPos const base = pos_base<P>();
+    IPos limit = strstart_ + base > (IPos)max_dist<P>() ?
+        strstart_ + base - (IPos)max_dist<P>() : 0;
+    /* Stop when cur_match becomes <= limit. To simplify the code,
+     * we prevent matches with the string of window index 0.
+     * cur_match and limit are positions, which are window indices
+     * plus base.
+     */
+    pos_type<P> *prev = this->prev<P>();
+    uInt wmask = w_mask<P>();
+
+    /* The binary tree found the longest match when the string
+     * was inserted.
+     */
+    if(P::dynamic && tree_)
+    {
+        if(bt_len_ <= (uInt)best_len)
+            return (uInt)best_len;
+        match_start_ = bt_start_;
+        if(bt_len_ <= lookahead_)
+            return bt_len_;
+        return lookahead_;
+    }
+
+    Byte scan_end1  = scan[best_len-1];
+    Byte scan_end   = scan[best_len];
+
+    BOOST_ASSERT(hash_bits_ >= 8);
+
+    /* Do not waste too much time if we already have a good match: */
+    if(prev_length_ >= good_match_) {
+        chain_length >>= 2;
+    }
+    /* Do not look for matches beyond the end of the input. This is necessary
+     * to make deflate deterministic.
+     */
+    if((uInt)nice_match > lookahead_)
+        nice_match = lookahead_;
+
+    BOOST_ASSERT((std::uint32_t)strstart_ <= window_size<P>() - kmin_lookahead);
+
+    std::size_t links = 0;
+    do {
+        BOOST_ASSERT(cur_match - base < strstart_);
+        match = window_ + (cur_match - base);
+        ++links;
+
+        /* Skip to next match if the match length cannot increase
+         * or if the match length is less than 2.  Note that the checks below
+         * for insufficient lookahead only occur occasionally for performance
+         * reasons.  Therefore uninitialized memory will be accessed, and
+         * conditional jumps will be made that depend on those values.
+         * However the length of the match is limited to the lookahead, so
+         * the output of deflate is not affected by the uninitialized values.
+         */
+        if(     match[best_len]   != scan_end  ||
+                match[best_len-1] != scan_end1 ||
+                match[0]          != scan[0]   ||
+                match[1]          != scan[1])
+            continue;
+
+        /* Extend the match from the third byte up to max_match. The third
+         * byte is compared too, so this does not depend on the hash
+         * function guaranteeing that it is equal. Nothing past
+         * strstart+max_match-1 is read.
+         */
+        len = 2 + static_cast<int>(match_length(
+            scan + 2, match + 2, max_match - 2));
+
+        if(len > best_len) {
+            match_start_ = cur_match - base;
+            best_len = len;
+            if(len >= nice_match) break;
+            scan_end1  = scan[best_len-1];
+            scan_end   = scan[best_len];
+        }
+    }
+    while((cur_match = prev[cur_match & wmask]) > limit
+        && --chain_length != 0);
+
+    count_search(links);
+
+    if((uInt)best_len <= lookahead_)
+        return (uInt)best_len;
+    return lookahead_;
+}
+
+/*  Copy without compression as much as possible from the input stream, return
+    the current block state.
+    Stored blocks of at least min_block bytes, or the rest of the input when
+    flushing, are copied straight from next_in to next_out when there is room
+    for them, and only the last w_size bytes copied are kept in the window
+    for later matches. Otherwise the input is gathered in the window and sent
+    through pending_buf. This function does not insert new strings in the
+    dictionary since uncompressible data is probably not useful; slides of
+    the window owed to the hash table are counted in stale_hash_. It is used
+    for the level=0 compression option and for the stored chunks of
+    Strategy::adaptive.
+*/
+template<class P>
+auto
+deflate_stream::
+f_stored(z_params& zs, Flush flush) ->
+    block_state
+{
+    std::uint32_t const max_stored = 0xffff;
+
+    /* Smallest worthy block size when not flushing or finishing. By default
+     * this is 32K. This can be as small as 507 bytes for memLevel == 1. For
+     * large input and output buffers, the stored block size will be larger.
+     */
+    std::uint32_t min_block =
+        (std::min)(pending_buf_size_ - 5, w_size<P>());
+
+    /* Copy as many min_block or larger stored blocks directly to next_out as
+     * possible. If flushing, copy the remaining available input to next_out as
+     * stored blocks, if there is enough space.
+     */
+    std::size_t len;
+    std::size_t left;
+    std::size_t have;
+    bool last = false;
+    std::size_t used = zs.avail_in;
+    do
+    {
+        /* Set len to the maximum size block that we can copy directly with the
+         * available input data and output space. Set left to how much of that
+         * would be copied from what's left in the window.
+         */
+        len = max_stored;
+        have = ((bi_valid_ + 42) >> 3) + pending_;  // header bytes
+        if(zs.avail_out < have)
+            break;
+        have = zs.avail_out - have;
+        left = strstart_ - block_start_;
+        if(len > left + zs.avail_in)
+            len = left + zs.avail_in;
+        if(len > have)
+            len = have;
+
+        /* If the stored block would be less than min_block in length, or if
+         * unable to copy all of the available input when flushing, then try
+         * copying to the window and the pending buffer instead. Also don't
+         * write an empty block when flushing -- doWrite does that.
+         */
+        if(len < min_block && ((len == 0 && flush != Flush::finish) ||
+                flush == Flush::none || len != left + zs.avail_in))
+            break;
+
+        /* Make a dummy stored block in pending to get the header bytes,
+         * including any pending bits, and replace its lengths with len.
+         */
+        last = flush == Flush::finish && len == left + zs.avail_in;
+        tr_stored_block(nullptr, 0L, last);
+        pending_buf_[pending_ - 4] = static_cast<Byte>(len);
+        pending_buf_[pending_ - 3] = static_cast<Byte>(len >> 8);
+        pending_buf_[pending_ - 2] = static_cast<Byte>(~len);
+        pending_buf_[pending_ - 1] = static_cast<Byte>(~len >> 8);
+        flush_pending(zs);
+
+        // Copy uncompressed bytes from the window to next_out
+        if(left)
+        {
+            if(left > len)
+                left = len;
+            std::memcpy(zs.next_out, window_ + block_start_, left);
+            zs.next_out = static_cast<Byte*>(zs.next_out) + left;
+            zs.avail_out -= left;
+            zs.total_out += left;
+            block_start_ += static_cast<long>(left);
+            len -= left;
+        }
+
+        /* Copy uncompressed bytes directly from next_in to next_out, updating
+         * the check value.
+         */
+        if(len)
+        {
+            read_buf<P>(zs, static_cast<Byte*>(zs.next_out),
+                static_cast<unsigned>(len));
+            zs.next_out = static_cast<Byte*>(zs.next_out) + len;
+            zs.avail_out -= len;
+            zs.total_out += len;
+        }
+    }
+    while(! last);
+
+    /* Update the sliding window with the last w_size bytes of the copied
+     * data, or append all of the copied data to the existing window if less
+     * than w_size bytes were copied. Also update the number of bytes to
+     * insert in the hash tables, in case another engine takes over.
+     */
+    used -= zs.avail_in;
+    if(used)
+    {
+        /* If any input was used, then no unused input remains in the window,
+         * therefore block_start == strstart.
+         */
+        auto const in = static_cast<Byte const*>(zs.next_in);
+        if(used >= w_size<P>())
+        {
+            // Clear the hash, or move long positions past all of it
+            if(P::wide)
+                slide_positions((strstart_ + w_mask<P>()) & ~w_mask<P>());
+            else
+                stale_hash_ = 2;
+            std::memcpy(window_, in - w_size<P>(), w_size<P>());
+            strstart_ = w_size<P>();
+        }
+        else
+        {
+            if(window_size<P>() - strstart_ <= used)
+            {
+                /* Slide the window down, keeping from w_size to
+                 * 2*w_size bytes with long positions.
+                 */
+                uInt const slide = P::wide ?
+                    (strstart_ - w_size<P>()) & ~w_mask<P>() : w_size<P>();
+                strstart_ -= slide;
+                std::memcpy(window_, window_ + slide, strstart_);
+                if(P::wide)
+                    slide_positions(slide);
+                else if(stale_hash_ < 2)
+                    ++stale_hash_;
+            }
+            std::memcpy(window_ + strstart_, in - used, used);
+            strstart_ += static_cast<uInt>(used);
+        }
+        block_start_ = strstart_;
+        insert_ += static_cast<uInt>(
+            (std::min)(used, std::size_t{w_size<P>() - insert_}));
+    }
+    if(high_water_ < strstart_)
+        high_water_ = strstart_;
+
+    // If the last block was written to next_out, then done
+    if(last)
+        return finish_done;
+
+    // If flushing and all input has been consumed, then done
+    if(flush != Flush::none && flush != Flush::finish &&
+        zs.avail_in == 0 && (long)strstart_ == block_start_)
+        return block_done;
+
+    // Fill the window with any remaining input
+    have = window_size<P>() - strstart_ - 1;
+    if(zs.avail_in > have && block_start_ >= (long)w_size<P>())
+    {
+        /* Slide the window down. Long positions keep at least w_size
+         * bytes, so that no position of the hash chains within reach
+         * of strstart is below the window.
+         */
+        uInt const slide = P::wide ? (std::min)(
+            static_cast<uInt>(block_start_),
+            strstart_ - w_size<P>()) & ~w_mask<P>() : w_size<P>();
+        block_start_ -= slide;
+        strstart_ -= slide;
+        std::memmove(window_, window_ + slide, strstart_);
+        if(P::wide)
+            slide_positions(slide);
+        else if(stale_hash_ < 2)
+            ++stale_hash_;
+        have += slide;
+    }
+    if(have > zs.avail_in)
+        have = zs.avail_in;
+    if(have)
+    {
+        read_buf<P>(zs, window_ + strstart_, static_cast<unsigned>(have));
+        strstart_ += static_cast<uInt>(have);
+    }
+    if(high_water_ < strstart_)
+        high_water_ = strstart_;
+
+    /* There was not enough avail_out to write a complete worthy or flushed
+     * stored block to next_out. Write a stored block to pending instead, if we
+     * have enough input for a worthy block, or if flushing and there is enough
+     * room for the remaining input as a stored block in the pending buffer.
+     */
+    have = (bi_valid_ + 42) >> 3;
+    have = (std::min)(std::size_t{pending_buf_size_ - pending_} - have,
+        std::size_t{max_stored});
+    min_block = static_cast<std::uint32_t>(
+        (std::min)(have, std::size_t{w_size<P>()}));
+    left = strstart_ - block_start_;
+    if(left >= min_block ||
+        ((left || flush == Flush::finish) && flush != Flush::none &&
+            zs.avail_in == 0 && left <= have))
+    {
+        len = (std::min)(left, have);
+        last = flush == Flush::finish && zs.avail_in == 0 && len == left;
+        tr_stored_block(reinterpret_cast<char*>(window_) + block_start_,
+            static_cast<std::uint32_t>(len), last);
+        block_start_ += static_cast<long>(len);
+        flush_pending(zs);
+    }
+
+    // We've done all we can with the available input and output
+    return last ? finish_started : need_more;
+}
+
+/*  Compress as much as possible from the input stream, return the current
+    block state.
+    This function does not perform lazy evaluation of matches and inserts
+    new strings in the dictionary only for unmatched strings or for short
+    matches. It is used only for the fast compression options.
+*/
+template<class P>
+auto
+deflate_stream::
+f_fast(z_params& zs, Flush flush) ->
+    block_state
+{
+    IPos hash_head;       /* head of the hash chain */
+    bool bflush;           /* set if current block must be flushed */
+
+    for(;;)
+    {
+        /* Make sure that we always have enough lookahead, except
+         * at the end of the input file. We need max_match bytes
+         * for the next match, plus min_match bytes to insert the
+         * string following the next match.
+         */
+        if(lookahead_ < kmin_lookahead)
+        {
+            fill_window<P>(zs);
+            if(lookahead_ < kmin_lookahead && flush == Flush::none)
+                return need_more;
+            if(lookahead_ == 0)
+                break; /* flush the current block */
+        }
+
+        /* Insert the string window[strstart .. strstart+2] in the
+         * dictionary, and set hash_head to the head of the hash chain:
+         */
+        hash_head = 0;
+        if(lookahead_ >= min_match) {
+            insert_string<P>(hash_head);
+        }
+
+        /* Find the longest match, discarding those <= prev_length.
+         * At this point we have always match_length < min_match
+         */
+        if(hash_head != 0 &&
+            strstart_ + pos_base<P>() - hash_head <= max_dist<P>()) {
+            /* To simplify the code, we prevent matches with the string
+             * of window index 0 (in particular we have to avoid a match
+             * of the string with itself at the start of the input file).
+             */
+            match_length_ = longest_match<P>(hash_head);
+            /* longest_match() sets match_start */
+            if(match_length_ < min_length_)
+                match_length_ = min_match - 1;
+        }
+        if(match_length_ >= min_match)
+        {
+            tr_tally_dist(static_cast<std::uint16_t>(strstart_ - match_start_),
+                          static_cast<std::uint8_t>(match_length_ - min_match), bflush);
+
+            lookahead_ -= match_length_;
+
+            /* Insert new strings in the hash table only if the match length
+             * is not too large. This saves time but degrades compression.
+             */
+            if(match_length_ <= max_lazy_match_ &&
+               lookahead_ >= min_match) {
+                match_length_--; /* string at strstart already in table */
+                do
+                {
+                    strstart_++;
+                    insert_string<P>(hash_head);
+                    /* strstart never exceeds WSIZE-max_match, so there are
+                     * always min_match bytes ahead.
+                     */
+                }
+                while(--match_length_ != 0);
+                strstart_++;
+            }
+            else
+            {
+                strstart_ += match_length_;
+                match_length_ = 0;
+                ins_h_ = window_[strstart_];
+                update_hash(ins_h_, window_[strstart_+1]);
+                /* If lookahead < min_match, ins_h is garbage, but it does not
+                 * matter since it will be recomputed at next deflate call.
+                 */
+            }
+        }
+        else
+        {
+            /* No match, output a literal byte */
+            tr_tally_lit(window_[strstart_], bflush);
+            lookahead_--;
+            strstart_++;
+        }
+        if(bflush)
+        {
+            flush_block(zs, false);
+            if(zs.avail_out == 0)
+                return need_more;
+        }
+    }
+    insert_ = strstart_ < min_match - 1 ? strstart_ : min_match - 1;
+    if(flush == Flush::finish)
+    {
+        flush_block(zs, true);
+        if(zs.avail_out == 0)
+            return finish_started;
+        return finish_done;
+    }
+    if(sym_next_)
+    {
+        flush_block(zs, false);
+        if(zs.avail_out == 0)
+            return need_more;
+    }
+    return block_done;
+}
+
+/*  Same as above, but achieves better compression. We use a lazy
+    evaluation for matches: a match is finally adopted only if there is
+    no better match at the next window position.
+*/
+template<class P>
+auto
+deflate_stream::
+f_slow(z_params& zs, Flush flush) ->
+    block_state
+{
+    IPos hash_head;          /* head of hash chain */
+    bool bflush;              /* set if current block must be flushed */
+
+    /* Process the input block. */
+    for(;;)
+    {
+        /* Make sure that we always have enough lookahead, except
+         * at the end of the input file. We need max_match bytes
+         * for the next match, plus min_match bytes to insert the
+         * string following the next match.
+         */
+        if(lookahead_ < kmin_lookahead)
+        {
+            fill_window<P>(zs);
+            if(lookahead_ < kmin_lookahead && flush == Flush::none)
+                return need_more;
+            if(lookahead_ == 0)
+                break; /* flush the current block */
+        }
+
+        /* Insert the string window[strstart .. strstart+2] in the
+         * dictionary, and set hash_head to the head of the hash chain:
+         */
+        hash_head = 0;
+        if(lookahead_ >= min_match)
+            insert_string<P>(hash_head);
+
+        /* Find the longest match, discarding those <= prev_length.
+         */
+        prev_length_ = match_length_, prev_match_ = match_start_;
+        match_length_ = min_match - 1;
+
+        if(hash_head != 0 && prev_length_ < max_lazy_match_ &&
+            strstart_ + pos_base<P>() - hash_head <= max_dist<P>())
+        {
+            /* To simplify the code, we prevent matches with the string
+             * of window index 0 (in particular we have to avoid a match
+             * of the string with itself at the start of the input file).
+             */
+            match_length_ = longest_match<P>(hash_head);
+            /* longest_match() sets match_start */
+
+            if(match_length_ <= 5 && (strategy_ == Strategy::filtered
+                || (match_length_ == min_match &&
+                    strstart_ - match_start_ > ktoo_far)
+                ))
+            {
+                /* If prev_match is also min_match, match_start is garbage
+                 * but we will ignore the current match anyway.
+                 */
+                match_length_ = min_match - 1;
+            }
+        }
+        /* If there was a match at the previous step and the current
+         * match is not better, output the previous match:
+         */
+        if(prev_length_ >= min_match && match_length_ <= prev_length_)
+        {
+            /* Do not insert strings in hash table beyond this. */
+            uInt max_insert = strstart_ + lookahead_ - min_match;
+
+            tr_tally_dist(
+                static_cast<std::uint16_t>(strstart_ -1 - prev_match_),
+                static_cast<std::uint8_t>(prev_length_ - min_match), bflush);
+
+            /* Insert in hash table all strings up to the end of the match.
+             * strstart-1 and strstart are already inserted. If there is not
+             * enough lookahead, the last two strings are not inserted in
+             * the hash table.
+             */
+            lookahead_ -= prev_length_-1;
+            prev_length_ -= 2;
+            do {
+                if(++strstart_ <= max_insert)
+                    insert_string<P>(hash_head);
+            }
+            while(--prev_length_ != 0);
+            match_available_ = 0;
+            match_length_ = min_match - 1;
+            strstart_++;
+
+            if(bflush)
+            {
+                flush_block(zs, false);
+                if(zs.avail_out == 0)
+                    return need_more;
+            }
+
+        }
+        else if(match_available_)
+        {
+            /* If there was no match at the previous position, output a
+             * single literal. If there was a match but the current match
+             * is longer, truncate the previous match to a single literal.
+             */
+            tr_tally_lit(window_[strstart_-1], bflush);
+            if(bflush)
+                flush_block(zs, false);
+            strstart_++;
+            lookahead_--;
+            if(zs.avail_out == 0)
+                return need_more;
+        }
+        else
+        {
+            /* There is no previous match to compare with, wait for
+             * the next step to decide.
+             */
+            match_available_ = 1;
+            strstart_++;
+            lookahead_--;
+        }
+    }
+    BOOST_ASSERT(flush != Flush::none);
+    if(match_available_)
+    {
+        tr_tally_lit(window_[strstart_-1], bflush);
+        match_available_ = 0;
+    }
+    insert_ = strstart_ < min_match - 1 ? strstart_ : min_match - 1;
+    if(flush == Flush::finish)
+    {
+        flush_block(zs, true);
+        if(zs.avail_out == 0)
+            return finish_started;
+        return finish_done;
+    }
+    if(sym_next_)
+    {
+        flush_block(zs, false);
+        if(zs.avail_out == 0)
+            return need_more;
+    }
+    return block_done;
+}
+
+} // detail
+} // deflate
+} // boost
+
+#endif
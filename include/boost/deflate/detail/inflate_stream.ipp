@@ -81,10 +81,51 @@ doWrite(z_params& zs, Flush flush, error_code& ec)
              */
 
 
+            // The checksum is taken as the output is copied to the window
+            auto const format = wrap(wrap_ % 128);
+            auto const sum =
+                [&](std::uint8_t const* p, std::size_t n)
+                {
+                    if(n == 0)
+                        return;
+                    if(format == boost::deflate::wrap::zlib)
+                        check_ = adler32(p, static_cast<unsigned>(n), check_);
+                    else if(format == boost::deflate::wrap::gzip)
+                        check_ = crc32(p, n, check_);
+                };
+            auto out = r.out.first;
+            auto n = r.out.used();
+
             // VFALCO TODO Don't allocate update the window unless necessary
-            if(/*wsize_ ||*/ (r.out.used() && mode_ < BAD &&
+            if(/*wsize_ ||*/ (n && mode_ < BAD &&
                     (mode_ < CHECK || flush != Flush::finish)))
-                w_.write(r.out.first, r.out.used());
+            {
+                if(format == boost::deflate::wrap::none)
+                {
+                    w_.write(out, n);
+                }
+                else
+                {
+                    // Only the last window's worth of output is kept
+                    if(n > w_.capacity())
+                    {
+                        sum(out, n - w_.capacity());
+                        out += n - w_.capacity();
+                        n = w_.capacity();
+                    }
+                    w_.write(out, n,
+                        [&](std::uint8_t* dst,
+                            std::uint8_t const* src, std::size_t len)
+                        {
+                            if(format == boost::deflate::wrap::zlib)
+                                check_ = adler32_copy(dst, src, len, check_);
+                            else
+                                check_ = crc32_copy(dst, src, len, check_);
+                        });
+                    n = 0;
+                }
+            }
+            sum(out, n);
 
             zs.next_in = r.in.next;
             zs.avail_in = r.in.avail();
@@ -96,11 +137,6 @@ doWrite(z_params& zs, Flush flush, error_code& ec)
                 (mode_ == TYPE ? 128 : 0) +
                 (mode_ == LEN_ || mode_ == COPY_ ? 256 : 0);
 
-            if(wrap(wrap_ % 128) !=boost::deflate::wrap::none) {
-                check_ = (wrap(wrap_ % 128) == boost::deflate::wrap::zlib) ?
-                         adler32(r.out.first, r.out.used(), check_) :
-                         crc32(r.out.first, r.out.used(), check_);
-            }
             if(((! r.in.used() && ! r.out.used()) ||
                     flush == Flush::finish) && ! ec)
                 ec = error::need_buffers;
@@ -700,7 +736,10 @@ doWrite(z_params& zs, Flush flush, error_code& ec)
                         adler32(r.out.first, r.out.used(), check_) :
                         crc32(r.out.first, r.out.used(), check_);
 
-                if((wrap_ / 128) && bswap(hold) != check_)
+                // zlib stores the Adler-32 big endian, gzip the CRC little endian
+                if(wrap(wrap_ % 128) == boost::deflate::wrap::zlib)
+                    hold = bswap(hold);
+                if((wrap_ / 128) && hold != check_)
                     return err(error::incorrect_data_check);
             }
 
@@ -0,0 +1,197 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_DETAIL_MATCH_LENGTH_HPP
+#define BOOST_DEFLATE_DETAIL_MATCH_LENGTH_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef BOOST_DEFLATE_USE_SSE2
+# include <emmintrin.h>
+#endif
+#ifdef BOOST_DEFLATE_USE_AVX2
+# include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+namespace boost {
+namespace deflate {
+namespace detail {
+
+// Index of the lowest set bit, v must not be zero
+inline
+unsigned
+count_trailing_zeros(std::uint64_t v) noexcept
+{
+    BOOST_DEFLATE_ASSERT(v != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return static_cast<unsigned>(i);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    if(_BitScanForward(&i, static_cast<unsigned long>(v)))
+        return static_cast<unsigned>(i);
+    _BitScanForward(&i, static_cast<unsigned long>(v >> 32));
+    return static_cast<unsigned>(i) + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+// Index of the highest set bit counted from the top, v must not be zero
+inline
+unsigned
+count_leading_zeros(std::uint64_t v) noexcept
+{
+    BOOST_DEFLATE_ASSERT(v != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return 63 - static_cast<unsigned>(i);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    if(_BitScanReverse(&i, static_cast<unsigned long>(v >> 32)))
+        return 31 - static_cast<unsigned>(i);
+    _BitScanReverse(&i, static_cast<unsigned long>(v));
+    return 63 - static_cast<unsigned>(i);
+#else
+    return static_cast<unsigned>(__builtin_clzll(v));
+#endif
+}
+
+/*  The match length kernels below return the number of leading
+    bytes which are equal in `a` and `b`, comparing at most `n`
+    bytes. All of them return the same value for the same input;
+    the wider kernels only differ in how many bytes are examined
+    per step. Reads never go past `a + n` or `b + n`.
+*/
+
+// One byte at a time, the reference implementation.
+inline
+std::size_t
+match_length_bytes(
+    std::uint8_t const* a,
+    std::uint8_t const* b,
+    std::size_t n) noexcept
+{
+    std::size_t len = 0;
+    while(len < n && a[len] == b[len])
+        ++len;
+    return len;
+}
+
+// Eight bytes at a time, using XOR and a bit scan.
+inline
+std::size_t
+match_length_word(
+    std::uint8_t const* a,
+    std::uint8_t const* b,
+    std::size_t n) noexcept
+{
+    std::size_t len = 0;
+    while(n - len >= 8)
+    {
+        std::uint64_t va;
+        std::uint64_t vb;
+        std::memcpy(&va, a + len, 8);
+        std::memcpy(&vb, b + len, 8);
+        auto const diff = va ^ vb;
+        if(diff != 0)
+        {
+#ifdef BOOST_DEFLATE_BIG_ENDIAN
+            return len + (count_leading_zeros(diff) >> 3);
+#else
+            return len + (count_trailing_zeros(diff) >> 3);
+#endif
+        }
+        len += 8;
+    }
+    return len + match_length_bytes(a + len, b + len, n - len);
+}
+
+#ifdef BOOST_DEFLATE_USE_SSE2
+// Sixteen bytes at a time, using compare and movemask.
+inline
+std::size_t
+match_length_sse2(
+    std::uint8_t const* a,
+    std::uint8_t const* b,
+    std::size_t n) noexcept
+{
+    std::size_t len = 0;
+    while(n - len >= 16)
+    {
+        auto const va = _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(a + len));
+        auto const vb = _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(b + len));
+        auto const mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xffffU;
+        if(mask != 0)
+            return len + count_trailing_zeros(mask);
+        len += 16;
+    }
+    return len + match_length_word(a + len, b + len, n - len);
+}
+#endif
+
+#ifdef BOOST_DEFLATE_USE_AVX2
+// Thirty-two bytes at a time, using compare and movemask.
+inline
+std::size_t
+match_length_avx2(
+    std::uint8_t const* a,
+    std::uint8_t const* b,
+    std::size_t n) noexcept
+{
+    std::size_t len = 0;
+    while(n - len >= 32)
+    {
+        auto const va = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(a + len));
+        auto const vb = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(b + len));
+        auto const mask = ~static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if(mask != 0)
+            return len + count_trailing_zeros(mask);
+        len += 32;
+    }
+    return len + match_length_sse2(a + len, b + len, n - len);
+}
+#endif
+
+// The widest kernel enabled for this build.
+BOOST_DEFLATE_FORCEINLINE
+std::size_t
+match_length(
+    std::uint8_t const* a,
+    std::uint8_t const* b,
+    std::size_t n) noexcept
+{
+#if defined(BOOST_DEFLATE_USE_AVX2)
+    return match_length_avx2(a, b, n);
+#elif defined(BOOST_DEFLATE_USE_SSE2)
+    return match_length_sse2(a, b, n);
+#else
+    return match_length_word(a, b, n);
+#endif
+}
+
+} // detail
+} // deflate
+} // boost
+
+#endif
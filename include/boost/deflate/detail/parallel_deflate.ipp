@@ -0,0 +1,365 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_DETAIL_PARALLEL_DEFLATE_IPP
+#define BOOST_DEFLATE_DETAIL_PARALLEL_DEFLATE_IPP
+
+#include <boost/deflate/parallel_deflate.hpp>
+#include <boost/deflate/deflate_stream.hpp>
+#include <boost/deflate/detail/adler.hpp>
+#include <boost/deflate/detail/crc.hpp>
+#include <boost/deflate/detail/deflate_stream.hpp>
+#include <boost/deflate/detail/header_constants.hpp>
+#include <boost/throw_exception.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace boost {
+namespace deflate {
+
+// The compressed output of one chunk
+struct parallel_deflate::chunk
+{
+    std::vector<std::uint8_t> out;
+    std::uint32_t check = 0;
+};
+
+// A raw deflate stream which can be primed with a dictionary
+class parallel_deflate::worker
+    : private detail::deflate_stream
+{
+public:
+    worker(int level, int memLevel, Strategy strategy)
+    {
+        doReset(level, 15, memLevel, strategy, wrap::none);
+    }
+
+    /*  Compress `in` into `c.out`, primed with the `dict_size`
+        bytes in front of `in`. The last chunk finishes the
+        stream, the others end on a byte-aligned sync flush.
+    */
+    void
+    compress(
+        std::uint8_t const* in,
+        std::size_t size,
+        std::size_t dict_size,
+        bool last,
+        chunk& c)
+    {
+        error_code ec;
+        doReset();
+        if(dict_size > 0)
+        {
+            doDictionary(in - dict_size, dict_size, ec);
+            if(ec)
+                BOOST_THROW_EXCEPTION(system_error{ec});
+        }
+
+        // A sync flush adds an empty stored block of five
+        // bytes and up to one more to byte-align the output.
+        c.out.resize(deflate_upper_bound(size) + 6);
+
+        z_params zs{};
+        zs.next_in = in;
+        zs.avail_in = size;
+        zs.next_out = c.out.data();
+        zs.avail_out = c.out.size();
+        for(;;)
+        {
+            doWrite(zs, last ? Flush::finish : Flush::sync, ec);
+            if(ec == error::end_of_stream)
+                break;
+            if(ec && ec != error::need_buffers)
+                BOOST_THROW_EXCEPTION(system_error{ec});
+            if(! last && zs.avail_in == 0 && zs.avail_out != 0)
+                break;
+            if(zs.avail_out == 0)
+            {
+                c.out.resize(c.out.size() * 2);
+                zs.next_out = c.out.data() + zs.total_out;
+                zs.avail_out = c.out.size() - zs.total_out;
+            }
+            ec = {};
+        }
+        c.out.resize(zs.total_out);
+    }
+};
+
+parallel_deflate::
+parallel_deflate()
+    : concurrency_(std::thread::hardware_concurrency())
+{
+    if(concurrency_ == 0)
+        concurrency_ = 1;
+}
+
+void
+parallel_deflate::
+reset(
+    int level,
+    int memLevel,
+    Strategy strategy,
+    wrap format)
+{
+    if(level == default_size)
+        level = 6;
+
+    if(level < 0 || level > max_level)
+        BOOST_THROW_EXCEPTION(std::invalid_argument{
+            "invalid level"});
+
+    if(memLevel < 1 || memLevel > 9)
+        BOOST_THROW_EXCEPTION(std::invalid_argument{
+            "invalid memLevel"});
+
+    level_ = level;
+    memLevel_ = memLevel;
+    strategy_ = strategy;
+    wrap_ = format;
+}
+
+void
+parallel_deflate::
+chunk_size(std::size_t bytes)
+{
+    // the checksums are computed a chunk at a time
+    if(bytes == 0 || bytes > (std::numeric_limits<unsigned>::max)())
+        BOOST_THROW_EXCEPTION(std::invalid_argument{
+            "invalid chunk size"});
+    chunk_size_ = bytes;
+}
+
+std::size_t
+parallel_deflate::
+upper_bound(std::size_t sourceLen) const
+{
+    std::size_t const chunks = sourceLen > 0 ?
+        (sourceLen + chunk_size_ - 1) / chunk_size_ : 1;
+    std::size_t wraplen = 0;
+    if(wrap_ == wrap::zlib)
+        wraplen = 2 + 4;
+    else if(wrap_ == wrap::gzip)
+        wraplen = 10 + 8;
+    return deflate_upper_bound(sourceLen) + chunks * 6 + wraplen;
+}
+
+void
+parallel_deflate::
+write(z_params& zs, error_code& ec)
+{
+    auto const in = static_cast<std::uint8_t const*>(zs.next_in);
+    auto const size = zs.avail_in;
+    std::size_t const n = size > 0 ?
+        (size + chunk_size_ - 1) / chunk_size_ : 1;
+
+    std::vector<chunk> chunks(n);
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr eptr;
+    std::mutex m;
+
+    // Each task compresses chunks until there are none left, so the
+    // assignment of chunks to threads has no effect on the output.
+    auto const task =
+        [&]
+        {
+            try
+            {
+                worker w(level_, memLevel_, strategy_);
+                for(;;)
+                {
+                    auto const i = next++;
+                    if(i >= n)
+                        break;
+                    auto const pos = i * chunk_size_;
+                    auto const len = (std::min)(chunk_size_, size - pos);
+                    std::size_t const dict = (std::min)(
+                        pos, std::size_t{dictionary_size});
+                    w.compress(in + pos, len, dict, i == n - 1, chunks[i]);
+                    if(wrap_ == wrap::zlib)
+                        chunks[i].check = detail::adler32(in + pos,
+                            static_cast<unsigned>(len),
+                            detail::adler32(nullptr, 0));
+                    else if(wrap_ == wrap::gzip)
+                        chunks[i].check = detail::crc32(in + pos, len,
+                            detail::crc32(nullptr, 0));
+                }
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if(! eptr)
+                    eptr = std::current_exception();
+                next = n;
+            }
+        };
+
+    std::size_t const tasks = (std::min)(concurrency_, n);
+    if(executor_)
+    {
+        // The tasks refer to this frame, so those submitted are waited
+        // for even when the executor throws.
+        std::condition_variable cv;
+        std::size_t done = 0;
+        std::size_t submitted = 0;
+        auto const wait =
+            [&]
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&]{ return done == submitted; });
+            };
+        try
+        {
+            for(; submitted < tasks; ++submitted)
+                executor_(
+                    [&]
+                    {
+                        task();
+                        std::lock_guard<std::mutex> lock(m);
+                        ++done;
+                        cv.notify_all();
+                    });
+        }
+        catch(...)
+        {
+            next = n;
+            wait();
+            throw;
+        }
+        wait();
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        auto const join =
+            [&]
+            {
+                for(auto& t : threads)
+                    t.join();
+            };
+        try
+        {
+            threads.reserve(tasks - 1);
+            for(std::size_t i = 1; i < tasks; ++i)
+                threads.emplace_back(task);
+        }
+        catch(...)
+        {
+            next = n;
+            join();
+            throw;
+        }
+        task();
+        join();
+    }
+    if(eptr)
+        std::rethrow_exception(eptr);
+
+    // Combine the checksums and measure the stream
+    std::uint32_t check = 0;
+    std::size_t total = 0;
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        auto const len = (std::min)(chunk_size_, size - i * chunk_size_);
+        if(i == 0)
+            check = chunks[i].check;
+        else if(wrap_ == wrap::zlib)
+            check = detail::adler32_combine(check, chunks[i].check, len);
+        else if(wrap_ == wrap::gzip)
+            check = detail::crc32_combine(check, chunks[i].check, len);
+        total += chunks[i].out.size();
+    }
+    std::uint8_t head[10];
+    std::uint8_t tail[8];
+    std::size_t head_size = 0;
+    std::size_t tail_size = 0;
+    if(wrap_ == wrap::zlib)
+    {
+        std::uint16_t header = (detail::ZMTH_DEFLATED |
+            (15 - 8) << detail::ZCINFO_MASK_TZ) << 8;
+        std::uint16_t lvl_flags = 3;
+        if( strategy_ == Strategy::huffman ||
+            strategy_ == Strategy::rle ||
+            strategy_ == Strategy::fixed || level_ < 2)
+            lvl_flags = 0;
+        else if(level_ < 6)
+            lvl_flags = 1;
+        else if(level_ == 6)
+            lvl_flags = 2;
+        header |= lvl_flags << detail::ZFLG_LEVEL_MASK_TZ;
+        header += detail::ZFLG_CHECK_FACTOR -
+            (header % detail::ZFLG_CHECK_FACTOR);
+        head[0] = static_cast<std::uint8_t>(header >> 8);
+        head[1] = static_cast<std::uint8_t>(header);
+        head_size = 2;
+        for(int i = 0; i < 4; ++i)
+            tail[i] = static_cast<std::uint8_t>(check >> (24 - 8 * i));
+        tail_size = 4;
+    }
+    else if(wrap_ == wrap::gzip)
+    {
+        head[0] = 31;
+        head[1] = 139;
+        head[2] = detail::DEFLATE;
+        std::memset(head + 3, 0, 5); // flags and time
+        head[8] = level_ >= 9 ? 2 :
+            (strategy_ == Strategy::huffman ||
+             strategy_ == Strategy::rle ||
+             strategy_ == Strategy::fixed || level_ < 2) ? 4 : 0;
+        head[9] = static_cast<std::uint8_t>(gz_os::unknown);
+        head_size = 10;
+        for(int i = 0; i < 4; ++i)
+        {
+            tail[i] = static_cast<std::uint8_t>(check >> (8 * i));
+            tail[4 + i] = static_cast<std::uint8_t>(
+                static_cast<std::uint32_t>(size) >> (8 * i));
+        }
+        tail_size = 8;
+    }
+    total += head_size + tail_size;
+    if(total > zs.avail_out)
+    {
+        ec = error::need_buffers;
+        return;
+    }
+
+    // Stitch the stream together
+    auto out = static_cast<std::uint8_t*>(zs.next_out);
+    std::memcpy(out, head, head_size);
+    out += head_size;
+    for(auto const& c : chunks)
+    {
+        if(! c.out.empty())
+            std::memcpy(out, c.out.data(), c.out.size());
+        out += c.out.size();
+    }
+    std::memcpy(out, tail, tail_size);
+    out += tail_size;
+
+    zs.next_in = in + size;
+    zs.avail_in = 0;
+    zs.total_in += size;
+    zs.next_out = out;
+    zs.avail_out -= total;
+    zs.total_out += total;
+    zs.check = check;
+    ec = error::end_of_stream;
+}
+
+} // deflate
+} // boost
+
+#endif
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_DETAIL_PREPARED_DICTIONARY_IPP
+#define BOOST_DEFLATE_DETAIL_PREPARED_DICTIONARY_IPP
+
+#include <boost/deflate/prepared_dictionary.hpp>
+#include <boost/deflate/detail/deflate_stream.hpp>
+#include <boost/throw_exception.hpp>
+
+namespace boost {
+namespace deflate {
+
+// A stream which hashes the dictionary and hands over its tables
+class prepared_dictionary::builder
+    : private detail::deflate_stream
+{
+public:
+    builder(int windowBits, int memLevel, Hash hash)
+    {
+        doReset(6, windowBits, memLevel, Strategy::normal, wrap::none);
+        doHash(hash);
+    }
+
+    void
+    build(prepared_dictionary& d,
+        std::uint8_t const* data, std::size_t size)
+    {
+        error_code ec;
+        doDictionary(data, size, ec);
+        if(ec)
+            BOOST_THROW_EXCEPTION(system_error{ec});
+
+        std::size_t const n = size > prepared_dictionary::max_size ?
+            prepared_dictionary::max_size : size;
+        d.data_.assign(data + size - n, data + size);
+        d.id_ = dict_id_;
+        d.w_bits_ = w_bits_;
+        d.hash_bits_ = hash_bits_;
+        d.hash_ = hash_;
+        d.strstart_ = strstart_;
+        d.insert_ = insert_;
+        d.ins_h_ = ins_h_;
+        d.head_.assign(head_, head_ + hash_size_);
+        d.prev_.assign(prev_, prev_ + strstart_);
+    }
+};
+
+prepared_dictionary::
+prepared_dictionary(
+    void const* data,
+    std::size_t size,
+    int windowBits,
+    int memLevel,
+    Hash hash)
+{
+    builder(windowBits, memLevel, hash).build(*this,
+        static_cast<std::uint8_t const*>(data), size);
+}
+
+} // deflate
+} // boost
+
+#endif
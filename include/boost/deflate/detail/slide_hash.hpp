@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_DETAIL_SLIDE_HASH_HPP
+#define BOOST_DEFLATE_DETAIL_SLIDE_HASH_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef BOOST_DEFLATE_USE_SSE2
+# include <emmintrin.h>
+#endif
+#if defined(BOOST_DEFLATE_USE_AVX2) || defined(BOOST_DEFLATE_DETECT_AVX2)
+# include <immintrin.h>
+#endif
+
+namespace boost {
+namespace deflate {
+namespace detail {
+
+/*  The slide kernels below move the n window positions at `p` down by
+    `wsize` when the window slides, replacing the positions which fall
+    off the start of the window with 0, which marks the end of a hash
+    chain. All of them give the same result; the wider kernels only
+    differ in how many positions are moved per step.
+*/
+
+// One position at a time, the reference implementation.
+inline
+void
+slide_hash_scalar(
+    std::uint16_t* p,
+    std::size_t n,
+    std::uint16_t wsize) noexcept
+{
+    for(std::size_t i = 0; i < n; ++i)
+        p[i] = static_cast<std::uint16_t>(
+            p[i] >= wsize ? p[i] - wsize : 0);
+}
+
+#ifdef BOOST_DEFLATE_USE_SSE2
+// Eight positions at a time, using an unsigned saturating subtract.
+inline
+void
+slide_hash_sse2(
+    std::uint16_t* p,
+    std::size_t n,
+    std::uint16_t wsize) noexcept
+{
+    auto const w = _mm_set1_epi16(static_cast<short>(wsize));
+    std::size_t i = 0;
+    for(; n - i >= 8; i += 8)
+    {
+        auto const v = _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(p + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i),
+            _mm_subs_epu16(v, w));
+    }
+    slide_hash_scalar(p + i, n - i, wsize);
+}
+#endif
+
+#if defined(BOOST_DEFLATE_USE_AVX2) || defined(BOOST_DEFLATE_DETECT_AVX2)
+// Sixteen positions at a time, using an unsigned saturating subtract.
+BOOST_DEFLATE_TARGET_AVX2
+inline
+void
+slide_hash_avx2(
+    std::uint16_t* p,
+    std::size_t n,
+    std::uint16_t wsize) noexcept
+{
+    auto const w = _mm256_set1_epi16(static_cast<short>(wsize));
+    std::size_t i = 0;
+    for(; n - i >= 16; i += 16)
+    {
+        auto const v = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(p + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i),
+            _mm256_subs_epu16(v, w));
+    }
+    slide_hash_scalar(p + i, n - i, wsize);
+}
+#endif
+
+using slide_hash_kernel = void(*)(
+    std::uint16_t*, std::size_t, std::uint16_t);
+
+// The widest kernel supported by this build and by the processor.
+inline
+slide_hash_kernel
+select_slide_hash() noexcept
+{
+#if defined(BOOST_DEFLATE_USE_AVX2)
+    return &slide_hash_avx2;
+#elif defined(BOOST_DEFLATE_DETECT_AVX2)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return &slide_hash_avx2;
+    return &slide_hash_sse2;
+#elif defined(BOOST_DEFLATE_USE_SSE2)
+    return &slide_hash_sse2;
+#else
+    return &slide_hash_scalar;
+#endif
+}
+
+// Slide with the kernel chosen on first use.
+inline
+void
+slide_hash(
+    std::uint16_t* p,
+    std::size_t n,
+    std::uint16_t wsize) noexcept
+{
+    static slide_hash_kernel const kernel = select_slide_hash();
+    kernel(p, n, wsize);
+}
+
+/*  Rebase the n long positions at `p` by `base`. Long positions are
+    only rebased once every two gigabytes of input, so the compiler's
+    code for the loop is enough.
+*/
+inline
+void
+slide_hash(
+    std::uint32_t* p,
+    std::size_t n,
+    std::uint32_t base) noexcept
+{
+    for(std::size_t i = 0; i < n; ++i)
+        p[i] = p[i] >= base ? p[i] - base : 0;
+}
+
+} // detail
+} // deflate
+} // boost
+
+#endif
@@ -111,6 +111,22 @@ public:
 
     void
     write(std::uint8_t const* in, std::size_t n)
+    {
+        write(in, n,
+            [](std::uint8_t* dst,
+                std::uint8_t const* src, std::size_t len)
+            {
+                std::memcpy(dst, src, len);
+            });
+    }
+
+    /*  Append the last bytes of `in` to the window, storing them
+        with `copy(dst, src, len)`. When `n` is at most the capacity,
+        every byte is stored, in order.
+    */
+    template<class Copy>
+    void
+    write(std::uint8_t const* in, std::size_t n, Copy const& copy)
     {
         if(! p_)
             p_ = boost::make_unique<
@@ -119,12 +135,12 @@ public:
         {
             i_ = 0;
             size_ = capacity_;
-            std::memcpy(&p_[0], in + (n - size_), size_);
+            copy(&p_[0], in + (n - size_), size_);
             return;
         }
         if(i_ + n <= capacity_)
         {
-            std::memcpy(&p_[i_], in, n);
+            copy(&p_[i_], in, n);
             if(size_ >= capacity_ - n)
                 size_ = capacity_;
             else
@@ -135,10 +151,10 @@ public:
             return;
         }
         auto m = capacity_ - i_;
-        std::memcpy(&p_[i_], in, m);
+        copy(&p_[i_], in, m);
         in += m;
         i_ = static_cast<std::uint16_t>(n - m);
-        std::memcpy(&p_[0], in, i_);
+        copy(&p_[0], in, i_);
         size_ = capacity_;
     }
 };
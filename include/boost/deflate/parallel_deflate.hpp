@@ -0,0 +1,179 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_PARALLEL_DEFLATE_HPP
+#define BOOST_DEFLATE_PARALLEL_DEFLATE_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <boost/deflate/error.hpp>
+#include <boost/deflate/deflate.hpp>
+#include <cstddef>
+#include <functional>
+
+namespace boost {
+namespace deflate {
+
+/** Multi-threaded deflate compressor.
+
+    This compresses a complete buffer by splitting it into chunks
+    of a fixed size which are compressed concurrently. Each chunk
+    after the first is primed with the last 32KiB of the chunk
+    before it, so matches may reach back across chunk boundaries
+    and the compression ratio stays close to that of a single
+    @ref deflate_stream. Every chunk but the last ends on a sync
+    flush boundary, which byte-aligns its output so the outputs
+    can be concatenated into one raw, zlib or gzip stream. For the
+    wrapped formats the checksum of each chunk is computed by the
+    worker compressing it, and the results are combined.
+
+    The output only depends on the input, the compression parameters
+    and the chunk size. It is the same for any number of threads and
+    for any order in which the chunks finish.
+*/
+class parallel_deflate
+{
+public:
+    /** A function which runs a task.
+
+        The executor is called with a task which it must invoke
+        exactly once, either on the calling thread or on another
+        thread. The compressor blocks until every task it submitted
+        has run.
+    */
+    using executor_type = std::function<void(std::function<void()>)>;
+
+    /// The default chunk size in bytes
+    static constexpr std::size_t default_chunk_size = 128 * 1024;
+
+    /// The number of trailing bytes of a chunk used to prime the next
+    static constexpr std::size_t dictionary_size = 32 * 1024;
+
+    /** Construct a parallel compressor.
+
+        Upon construction the settings are:
+
+        @li `level = 6`
+
+        @li `memLevel = 8`
+
+        @li `strategy = Strategy::normal`
+
+        @li `format = wrap::none`
+
+        @li `chunk_size = default_chunk_size`
+
+        @li `concurrency = std::thread::hardware_concurrency()`
+
+        Tasks run on threads owned by the compressor until an
+        executor is set.
+    */
+    BOOST_DEFLATE_DECL
+    parallel_deflate();
+
+    /** Set the compression parameters.
+
+        The parameters have the same meaning as those of
+        @ref deflate_stream::reset. The window size is always
+        15 bits, so that every chunk sees the full dictionary.
+
+        @throws std::invalid_argument if a parameter is out of range.
+    */
+    BOOST_DEFLATE_DECL
+    void
+    reset(
+        int level,
+        int memLevel,
+        Strategy strategy,
+        wrap format = wrap::none);
+
+    /** Set the chunk size.
+
+        Smaller chunks expose more parallelism, larger chunks lose
+        less compression at the chunk boundaries.
+
+        @throws std::invalid_argument if `bytes` is zero or
+        does not fit in an `unsigned`.
+    */
+    BOOST_DEFLATE_DECL
+    void
+    chunk_size(std::size_t bytes);
+
+    /** Set the maximum number of chunks compressed at once.
+
+        A value of zero is treated as one. This does not affect
+        the output.
+    */
+    void
+    concurrency(std::size_t n) noexcept
+    {
+        concurrency_ = n != 0 ? n : 1;
+    }
+
+    /** Set the executor used to run the compression tasks.
+
+        Passing an empty function restores the default, which
+        runs the tasks on threads owned by the compressor.
+    */
+    void
+    executor(executor_type ex)
+    {
+        executor_ = std::move(ex);
+    }
+
+    /** Return an upper bound on the compressed size.
+
+        The bound includes the wrapper for the current format.
+    */
+    BOOST_DEFLATE_DECL
+    std::size_t
+    upper_bound(std::size_t sourceLen) const;
+
+    /** Compress a complete buffer.
+
+        All `zs.avail_in` bytes at `zs.next_in` are compressed into a
+        finished stream which is written to `zs.next_out`, and the
+        fields of `zs` are advanced as for @ref deflate_stream::write
+        with `Flush::finish`.
+
+        When the output does not fit in `zs.avail_out`, nothing is
+        consumed or produced and `ec` is set to `error::need_buffers`.
+        A buffer of @ref upper_bound bytes is always large enough.
+
+        @param zs The input and output buffers.
+
+        @param ec Set to `error::end_of_stream` when the stream was
+        written.
+
+        @throws Any exception thrown by the executor or by a task.
+    */
+    BOOST_DEFLATE_DECL
+    void
+    write(z_params& zs, error_code& ec);
+
+private:
+    struct chunk;
+    class worker;
+
+    int level_ = 6;
+    int memLevel_ = 8;
+    Strategy strategy_ = Strategy::normal;
+    wrap wrap_ = wrap::none;
+    std::size_t chunk_size_ = default_chunk_size;
+    std::size_t concurrency_;
+    executor_type executor_;
+};
+
+} // deflate
+} // boost
+
+#ifdef BOOST_DEFLATE_HEADER_ONLY
+#include <boost/deflate/detail/parallel_deflate.ipp>
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+#ifndef BOOST_DEFLATE_PREPARED_DICTIONARY_HPP
+#define BOOST_DEFLATE_PREPARED_DICTIONARY_HPP
+
+#include <boost/deflate/detail/config.hpp>
+#include <boost/deflate/deflate.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace boost {
+namespace deflate {
+
+namespace detail {
+class deflate_stream;
+} // detail
+
+/** A preset dictionary hashed once for many streams.
+
+    Setting a dictionary on a @ref deflate_stream inserts every
+    string of the dictionary into the match finder, which costs
+    about as much as compressing it. A prepared dictionary does
+    that work once, and keeps the window and the hash chains it
+    produced. A stream started from it copies them instead, which
+    makes dictionaries affordable for many small messages.
+
+    The object is immutable after construction, so any number of
+    streams on any number of threads may use it at once.
+
+    The hash chains are only valid for streams with the window
+    size, memory level and hash function the dictionary was
+    prepared for, which use hash chains as their match finder.
+    Other streams insert the dictionary bytes as if they had
+    been passed to @ref deflate_stream::set_dictionary, with the
+    same result.
+*/
+class prepared_dictionary
+{
+public:
+    /// The largest number of trailing dictionary bytes which are kept
+    static constexpr std::size_t max_size = 32 * 1024;
+
+    /** Prepare a dictionary.
+
+        Only the last `1 << windowBits` bytes of the dictionary
+        are used by the streams it was prepared for, and at most
+        the last @ref max_size bytes are kept for other streams.
+
+        @param data A pointer to the dictionary bytes.
+
+        @param size The number of dictionary bytes.
+
+        @param windowBits The window size of the streams, as
+        passed to @ref deflate_stream::reset.
+
+        @param memLevel The memory level of the streams, as
+        passed to @ref deflate_stream::reset.
+
+        @param hash The hash function of the streams, as passed
+        to @ref deflate_stream::hash.
+
+        @throws std::invalid_argument if a parameter is out of range.
+    */
+    BOOST_DEFLATE_DECL
+    prepared_dictionary(
+        void const* data,
+        std::size_t size,
+        int windowBits,
+        int memLevel,
+        Hash hash = Hash::rolling);
+
+    /// Return the number of dictionary bytes kept
+    std::size_t
+    size() const noexcept
+    {
+        return data_.size();
+    }
+
+private:
+    friend class detail::deflate_stream;
+    class builder;
+
+    std::vector<std::uint8_t> data_;    // the last max_size bytes
+    std::uint32_t id_;                  // adler32 of all the bytes
+    std::vector<std::uint16_t> head_;   // heads of the hash chains
+    std::vector<std::uint16_t> prev_;   // links of the window strings
+
+    unsigned w_bits_;                   // parameters prepared for
+    unsigned hash_bits_;
+    Hash hash_;
+
+    unsigned strstart_;                 // window bytes, a tail of data_
+    unsigned insert_;                   // trailing bytes not yet hashed
+    unsigned ins_h_;                    // rolling hash after them
+};
+
+} // deflate
+} // boost
+
+// The implementation is included after the stream it is built with
+#ifdef BOOST_DEFLATE_HEADER_ONLY
+#include <boost/deflate/detail/deflate_stream.hpp>
+#endif
+
+#endif
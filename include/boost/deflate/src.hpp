@@ -28,6 +28,8 @@ the program, with the macro BOOST_DEFLATE_SEPARATE_COMPILATION defined.
 #include <boost/deflate/detail/easy.ipp>
 #include <boost/deflate/detail/deflate_stream.ipp>
 #include <boost/deflate/detail/inflate_stream.ipp>
+#include <boost/deflate/detail/parallel_deflate.ipp>
+#include <boost/deflate/detail/prepared_dictionary.ipp>
 #include <boost/deflate/impl/error.ipp>
 
 #endif
\ No newline at end of file
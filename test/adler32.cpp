@@ -11,6 +11,8 @@
 #include <boost/deflate/detail/adler.hpp>
 #include "test_suite.hpp"
 
+#include <string>
+
 #include "zlib-1.2.11/zlib.h"
 
 namespace boost {
@@ -47,6 +49,29 @@ public:
         BOOST_TEST(eq("\x15\xb0"));
         BOOST_TEST(eq("\x02", 1, 0xfff0));
 
+        std::string text(7000, 'x');
+        for(std::size_t i = 0; i < text.size(); ++i)
+            text[i] = static_cast<char>(i * 7 + (i >> 5));
+        const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+        for(unsigned split : {0U, 1U, 15U, 5552U, 6999U, 7000U}) {
+            const auto a1 = adler32(data, split, adler32(nullptr, 0));
+            const auto a2 = adler32(data + split, 7000 - split, adler32(nullptr, 0));
+            BOOST_TEST(adler32_combine(a1, a2, 7000 - split) == adler32(data, 7000, adler32(nullptr, 0)));
+            BOOST_TEST(adler32_combine(a1, a2, 7000 - split) == ::adler32_combine(a1, a2, 7000 - split));
+        }
+
+        // the copying kernel gives the same checksum, at every length and alignment
+        std::string copy(7100, '\0');
+        auto* out = reinterpret_cast<unsigned char*>(&copy[0]);
+        for(unsigned len : {0U, 1U, 31U, 32U, 33U, 100U, 5552U, 5600U, 6990U}) {
+            for(unsigned off : {0U, 1U, 9U}) {
+                const auto expected = ::adler32(0x00ff0010, data + off, len);
+                BOOST_TEST(adler32(data + off, len, 0x00ff0010) == expected);
+                BOOST_TEST(adler32_copy(out + 3, data + off, len, 0x00ff0010) == expected);
+                BOOST_TEST(std::memcmp(out + 3, data + off, len) == 0);
+            }
+        }
+
   }
 };
 
@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+// Test that header file is self-contained.
+#include <boost/deflate/basic_deflate_stream.hpp>
+
+#include <boost/deflate/basic_inflate_stream.hpp>
+#include <boost/deflate/deflate_stream.hpp>
+
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "test_suite.hpp"
+#include "zlib-1.2.11/zlib.h"
+
+namespace boost {
+namespace deflate {
+
+class basic_deflate_stream_test
+{
+public:
+    // Text with long and short repeats, larger than the windows
+    static
+    std::string
+    corpus(std::size_t n)
+    {
+        static char const* const words[] = {
+            "deflate", "stream", "window", "match", "literal",
+            "distance", "length", "block", "huffman", "tree" };
+        std::mt19937 g(3);
+        std::string s;
+        while(s.size() < n)
+        {
+            s += words[g() % 10];
+            s += g() % 7 ? ' ' : '\n';
+            if(g() % 50 == 0)
+                s += std::to_string(g());
+        }
+        s.resize(n);
+        return s;
+    }
+
+    // Compress in with small buffers, so the window slides mid-call
+    template<class Stream>
+    static
+    std::string
+    compress(Stream& ds, std::string const& in)
+    {
+        std::string out;
+        out.resize(ds.upper_bound(in.size()) + 64);
+        z_params zp{};
+        zp.next_in = in.data();
+        zp.next_out = &out[0];
+        error_code ec;
+        for(;;)
+        {
+            auto const in_left = in.size() - zp.total_in;
+            zp.avail_in = (std::min)(in_left, std::size_t{5000});
+            zp.avail_out = (std::min)(
+                out.size() - zp.total_out, std::size_t{3000});
+            ds.write(zp, zp.avail_in == in_left ?
+                Flush::finish : Flush::none, ec);
+            if(ec == error::end_of_stream)
+                break;
+            if(! BOOST_TEST(! ec))
+                return {};
+        }
+        out.resize(zp.total_out);
+        return out;
+    }
+
+    static
+    std::string
+    compress(
+        std::string const& in,
+        int level, int windowBits, wrap format)
+    {
+        deflate_stream ds;
+        ds.reset(level, windowBits, 8, Strategy::normal, format);
+        return compress(ds, in);
+    }
+
+    // Inflate with zlib, windowBits as for inflateInit2
+    static
+    int
+    zlib_decompress(
+        std::string const& in,
+        std::size_t size,
+        int windowBits,
+        std::string& out)
+    {
+        z_stream zs{};
+        inflateInit2(&zs, windowBits);
+        out.resize(size + 1);
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = static_cast<uInt>(in.size());
+        zs.next_out = (Bytef*)&out[0];
+        zs.avail_out = static_cast<uInt>(out.size());
+        int const result = inflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+        return result;
+    }
+
+    // A static stream gives the output of the dynamic one
+    template<class Wrap, int WindowBits, class Engine>
+    void
+    check(std::string const& in, int level)
+    {
+        basic_deflate_stream<Wrap, WindowBits, Engine> ds;
+        ds.reset(level, 8, Strategy::normal);
+        auto const out = compress(ds, in);
+        BOOST_TEST(out == compress(in, level, WindowBits, Wrap::value));
+        std::string s;
+        BOOST_TEST(zlib_decompress(out, in.size(),
+            Wrap::value == wrap::none ? -15 :
+            Wrap::value == wrap::zlib ? WindowBits :
+                WindowBits + 16, s) == Z_STREAM_END);
+        BOOST_TEST(s == in);
+
+        // again after reset, reusing the buffers
+        ds.reset();
+        BOOST_TEST(compress(ds, in) == out);
+    }
+
+    void
+    testIdentical()
+    {
+        auto const in = corpus(200000);
+        check<policy::raw, 15, policy::stored>(in, 0);
+        for(int level = 1; level <= 3; ++level)
+        {
+            check<policy::raw, 15, policy::fast>(in, level);
+            check<policy::raw, 9, policy::fast>(in, level);
+            check<policy::zlib, 12, policy::fast>(in, level);
+        }
+        for(int level = 4; level <= 9; ++level)
+        {
+            check<policy::raw, 15, policy::lazy>(in, level);
+            check<policy::raw, 9, policy::lazy>(in, level);
+            check<policy::gzip, 13, policy::lazy>(in, level);
+        }
+    }
+
+    void
+    testDefaults()
+    {
+        auto const in = corpus(50000);
+        basic_deflate_stream<policy::raw, 15, policy::lazy> lazy;
+        deflate_stream dyn;
+        BOOST_TEST(compress(lazy, in) == compress(dyn, in));
+        basic_deflate_stream<policy::raw, 15, policy::fast> fast;
+        fast.reset(default_size, 8, Strategy::normal);
+        BOOST_TEST(compress(fast, in) ==
+            compress(in, 1, 15, wrap::none));
+        BOOST_TEST(decltype(fast)::format == wrap::none);
+        BOOST_TEST(decltype(fast)::window_bits == 15);
+    }
+
+    void
+    testInvalid()
+    {
+        basic_deflate_stream<policy::raw, 15, policy::fast> ds;
+        BOOST_TEST_THROWS(ds.reset(4, 8, Strategy::normal),
+            std::invalid_argument);
+        BOOST_TEST_THROWS(ds.reset(0, 8, Strategy::normal),
+            std::invalid_argument);
+        BOOST_TEST_THROWS(ds.reset(1, 8, Strategy::huffman),
+            std::invalid_argument);
+        BOOST_TEST_THROWS(ds.reset(1, 0, Strategy::normal),
+            std::invalid_argument);
+    }
+
+    void
+    testDynamic()
+    {
+        auto const in = corpus(50000);
+        basic_deflate_stream<policy::dynamic,
+            policy::dynamic_window_bits, policy::dynamic> ds;
+        ds.reset(11, 15, 8, Strategy::normal);
+        BOOST_TEST(compress(ds, in) ==
+            compress(in, 11, 15, wrap::none));
+    }
+
+    template<class Stream>
+    static
+    std::string
+    decompress(Stream& is, std::string const& in, std::size_t size)
+    {
+        std::string out;
+        out.resize(size + 1);
+        z_params zp{};
+        zp.next_in = in.data();
+        zp.avail_in = in.size();
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        error_code ec;
+        is.write(zp, Flush::finish, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        out.resize(zp.total_out);
+        return out;
+    }
+
+    void
+    testInflate()
+    {
+        auto const in = corpus(100000);
+        auto const out = compress(in, 6, 15, wrap::none);
+
+        basic_inflate_stream<policy::raw, 15> is;
+        BOOST_TEST(decompress(is, out, in.size()) == in);
+        is.reset();
+        BOOST_TEST(decompress(is, out, in.size()) == in);
+        is.clear();
+        is.reset();
+        BOOST_TEST(decompress(is, out, in.size()) == in);
+
+        auto const small = compress(in, 6, 9, wrap::none);
+        basic_inflate_stream<policy::raw, 9> is9;
+        BOOST_TEST(decompress(is9, small, in.size()) == in);
+
+        basic_inflate_stream<policy::dynamic,
+            policy::dynamic_window_bits> dyn;
+        dyn.reset(15);
+        BOOST_TEST(decompress(dyn, out, in.size()) == in);
+    }
+
+    void
+    run()
+    {
+        testIdentical();
+        testDefaults();
+        testInvalid();
+        testDynamic();
+        testInflate();
+    }
+};
+
+TEST_SUITE(basic_deflate_stream_test, "basic_deflate_stream");
+
+} // deflate
+} // boost
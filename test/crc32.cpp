@@ -11,6 +11,8 @@
 #include <boost/deflate/detail/crc.hpp>
 #include "test_suite.hpp"
 
+#include <string>
+
 #include "zlib-1.2.11/zlib.h"
 
 namespace boost {
@@ -38,6 +40,31 @@ namespace boost {
                         "ed vitae nulla. Proin erat mi, gravida at suscipit non, rhoncus vitae nibh. Maec" \
                         "enas cursus maximus leo eu tristique."));
 
+            const char* text = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_";
+            const auto* data = reinterpret_cast<const unsigned char*>(text);
+            const auto size = std::strlen(text);
+            for(std::size_t split = 0; split <= size; ++split) {
+              const auto crc1 = crc32(data, split, crc32(nullptr, 0));
+              const auto crc2 = crc32(data + split, size - split, crc32(nullptr, 0));
+              BOOST_TEST(crc32_combine(crc1, crc2, size - split) == crc32(data, size, crc32(nullptr, 0)));
+              BOOST_TEST(crc32_combine(crc1, crc2, size - split) == ::crc32_combine(crc1, crc2, size - split));
+            }
+
+            // the copying kernel gives the same checksum, at every length and alignment
+            std::string large(5000, '\0');
+            for(std::size_t i = 0; i < large.size(); ++i)
+              large[i] = static_cast<char>(i * 31 + (i >> 7));
+            const auto* in = reinterpret_cast<const unsigned char*>(large.data());
+            std::string copy(large.size() + 16, '\0');
+            auto* out = reinterpret_cast<unsigned char*>(&copy[0]);
+            for(std::size_t len : {0, 15, 63, 64, 65, 80, 127, 128, 1000, 4990}) {
+              for(std::size_t off : {0, 1, 9}) {
+                const auto expected = ::crc32(0x12345678, in + off, static_cast<uInt>(len));
+                BOOST_TEST(crc32(in + off, len, 0x12345678) == expected);
+                BOOST_TEST(crc32_copy(out + 5, in + off, len, 0x12345678) == expected);
+                BOOST_TEST(std::memcmp(out + 5, in + off, len) == 0);
+              }
+            }
 
         }
       };
@@ -12,6 +12,7 @@
 #include <boost/deflate/deflate_stream.hpp>
 #include <boost/deflate/deflate.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <iostream>
@@ -197,6 +198,33 @@ public:
         return s;
     }
 
+    // Text-like data with back references at varying distances
+    static
+    std::string corpus3(std::size_t n)
+    {
+        std::string s;
+        s.reserve(n);
+        std::mt19937 g;
+        std::uniform_int_distribution<int> d0{'a', 'z'};
+        std::uniform_int_distribution<std::size_t> d1{3, 300};
+        std::uniform_int_distribution<int> d2{0, 3};
+        while(s.size() < n)
+        {
+            if(d2(g) == 0 && s.size() > 512)
+            {
+                auto const len = d1(g);
+                auto const pos = g() % (s.size() - len);
+                s.append(s, pos, len);
+            }
+            else
+            {
+                s.push_back(static_cast<char>(d0(g)));
+            }
+        }
+        s.resize(n);
+        return s;
+    }
+
     static
     std::string compress(
         string_view const& in,
@@ -241,7 +269,9 @@ public:
         std::string out;
         z_stream zs;
         memset(&zs, 0, sizeof(zs));
-        result = inflateInit2(&zs, wrap == boost::deflate::wrap::none ? -15 : 15);
+        result = inflateInit2(&zs,
+            wrap == boost::deflate::wrap::none ? -15 :
+            wrap == boost::deflate::wrap::zlib ? 15 : 15 + 16);
         if(result != Z_OK)
             throw std::logic_error{"inflateInit2 failed"};
         try
@@ -296,6 +326,7 @@ public:
         case 2: return Strategy::huffman;
         case 3: return Strategy::rle;
         case 4: return Strategy::fixed;
+        case 5: return Strategy::quick;
         }
     }
 
@@ -592,11 +623,1489 @@ public:
         }
     }
 
+    // The output must be byte for byte what zlib produces
+    // for the same settings, regardless of which match
+    // length kernel the build selected.
+    static
+    void testZlibIdentical()
+    {
+        auto const check = [](
+            std::string const& in,
+            int level, int windowBits, int memLevel, int strategy)
+        {
+            z_stream zs{};
+            deflateInit2(&zs, level, Z_DEFLATED,
+                -windowBits, memLevel, strategy);
+            std::string expected;
+            expected.resize(deflateBound(&zs,
+                static_cast<uLong>(in.size())));
+            zs.next_in = (Bytef*)in.data();
+            zs.avail_in = static_cast<uInt>(in.size());
+            zs.next_out = (Bytef*)&expected[0];
+            zs.avail_out = static_cast<uInt>(expected.size());
+            ::deflate(&zs, Z_FINISH);
+            expected.resize(zs.total_out);
+            deflateEnd(&zs);
+
+            deflate_stream ds;
+            ds.reset(level, windowBits, memLevel, toStrategy(strategy));
+            std::string out;
+            out.resize(ds.upper_bound(in.size()) + 64);
+            z_params zp{};
+            zp.next_in = in.data();
+            zp.avail_in = in.size();
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(out == expected);
+        };
+
+        auto const in1 = corpus1(100000);
+        auto const in3 = corpus3(100000);
+        for(int level = 1; level <= 9; ++level)
+        {
+            for(int strategy = 0; strategy <= 4; ++strategy)
+            {
+                check(in1, level, 15, 8, strategy);
+                check(in3, level, 15, 8, strategy);
+                check(in3, level, 9, 1, strategy);
+            }
+
+            // The input ends at various points of the window
+            for(std::size_t size : { 600, 33000, 65537, 70000 })
+            {
+                check(in3.substr(0, size), level, 15, 8, 0);
+                check(in3.substr(0, size), level, 9, 1, 0);
+            }
+        }
+    }
+
+    // Input which is given all at once is compressed in the
+    // caller's buffer, which may change once write returns.
+    void testBorrowedWindow()
+    {
+        auto const in = corpus3(150000) + corpus1(50000);
+        for(int level : { 1, 6, 9, 12 })
+        {
+            for(int strategy = 0; strategy <= 5; ++strategy)
+            {
+                deflate_stream ds;
+                ds.reset(level, 15, 8, toStrategy(strategy));
+                std::string buf = in;
+                std::string out;
+                out.resize(ds.upper_bound(in.size()));
+                z_params zp{};
+                zp.next_in = buf.data();
+                zp.avail_in = buf.size();
+                zp.next_out = &out[0];
+                zp.avail_out = 7000;
+                error_code ec;
+                for(;;)
+                {
+                    ds.write(zp, Flush::finish, ec);
+                    if(ec == error::end_of_stream)
+                        break;
+                    BOOST_TEST(! ec);
+                    if(ec)
+                        break;
+
+                    // Overwrite the input which has been consumed
+                    std::fill(&buf[0], &buf[zp.total_in], 'x');
+                    zp.avail_out = (std::min<std::size_t>)(7000,
+                        out.size() - zp.total_out);
+                }
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+            }
+        }
+    }
+
+    // Bits primed and bits left pending after each kind of
+    // flush must be exactly what zlib reports.
+    static
+    void testPrimeAndPending()
+    {
+        auto const in = corpus3(5000);
+        for(auto flush : {Flush::block, Flush::partial, Flush::sync})
+        {
+            z_stream zs{};
+            deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            deflate_stream ds;
+            ds.reset(6, 15, 8, Strategy::normal);
+
+            BOOST_TEST(deflatePrime(&zs, 13, 0x1234) == Z_OK);
+            error_code ec;
+            ds.prime(13, 0x1234, ec);
+            BOOST_TEST(! ec);
+
+            std::string expected(8192, 0);
+            std::string out(8192, 0);
+            z_params zp{};
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            zs.next_out = (Bytef*)&expected[0];
+            zs.avail_out = static_cast<uInt>(expected.size());
+            constexpr static int zlib_flushes[] = {
+                0, Z_BLOCK, Z_PARTIAL_FLUSH, Z_SYNC_FLUSH};
+            for(std::size_t i = 0; i < in.size(); i += 1000)
+            {
+                zs.next_in = (Bytef*)&in[i];
+                zs.avail_in = 1000;
+                ::deflate(&zs, zlib_flushes[static_cast<int>(flush)]);
+                zp.next_in = &in[i];
+                zp.avail_in = 1000;
+                ds.write(zp, flush, ec);
+                BOOST_TEST(! ec);
+
+                unsigned zpending;
+                int zbits;
+                deflatePending(&zs, &zpending, &zbits);
+                unsigned pending;
+                int bits;
+                ds.pending(&pending, &bits);
+                BOOST_TEST(pending == zpending);
+                BOOST_TEST(bits == zbits);
+                BOOST_TEST(zp.total_out == zs.total_out);
+            }
+            expected.resize(zs.total_out);
+            out.resize(zp.total_out);
+            BOOST_TEST(out == expected);
+            deflateEnd(&zs);
+        }
+    }
+
+    static
+    void testHash()
+    {
+        auto const in = corpus3(200000);
+        for(int level = 1; level <= 9; ++level)
+        {
+            for(auto h : {Hash::rolling, Hash::multiplicative, Hash::crc32c})
+            {
+                deflate_stream ds;
+                ds.hash(h);
+                ds.reset(level, 15, 8, Strategy::normal);
+                std::string out;
+                out.resize(ds.upper_bound(in.size()));
+                z_params zp{};
+                zp.next_in = in.data();
+                zp.avail_in = in.size();
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+
+                auto const& st = ds.stats();
+                BOOST_TEST(st.searches > 0);
+                BOOST_TEST(st.chain_links >= st.searches);
+                BOOST_TEST(st.max_chain > 0);
+            }
+        }
+
+        // Statistics are cleared on reset
+        deflate_stream ds;
+        ds.reset();
+        BOOST_TEST(ds.stats().searches == 0);
+    }
+
+    void testOptimal()
+    {
+        // Small buffers and every strategy
+        for(int level = compression::optimal_size;
+            level <= compression::max_level; ++level)
+        {
+            for(int strategy = 0; strategy <= 4; ++strategy)
+            {
+                doDeflate1_beast(beast_compressor,
+                    level, 9, 1, strategy, corpus1(1024));
+                doDeflate2_beast(beast_compressor,
+                    level, 15, 8, strategy, corpus1(56));
+            }
+        }
+
+        // Larger input, compared with level 9
+        auto const in = corpus3(300000);
+        auto const deflate = [&](int level, Flush flush)
+            {
+                deflate_stream ds;
+                ds.reset(level, 15, 8, Strategy::normal);
+                std::string out;
+                out.resize(ds.upper_bound(in.size()));
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += 10000)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min<std::size_t>)(10000, in.size() - pos);
+                    ds.write(zp, flush, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return out.size();
+            };
+        auto const size9 = deflate(9, Flush::none);
+        for(int level = compression::optimal_size;
+            level <= compression::max_level; ++level)
+        {
+            auto const size = deflate(level, Flush::none);
+            BOOST_TEST(size < size9);
+            BOOST_TEST(deflate(level, Flush::sync) < size9 + size9 / 20);
+        }
+
+        // Switching to and from the optimal parser
+        {
+            deflate_stream ds;
+            ds.reset(6, 15, 8, Strategy::normal);
+            std::string out;
+            out.resize(ds.upper_bound(in.size()));
+            z_params zp{};
+            zp.next_in = in.data();
+            zp.avail_in = in.size() / 3;
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            ds.params(zp, 11, Strategy::normal, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = in.size() / 3;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            ds.params(zp, 4, Strategy::normal, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = in.size() - zp.total_in;
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == in);
+        }
+
+        deflate_stream ds;
+        BOOST_TEST_THROWS(
+            ds.reset(compression::max_level + 1, 15, 8, Strategy::normal),
+            std::invalid_argument);
+    }
+
+    void testQuick()
+    {
+        // Small buffers, incompressible input fits in the bound
+        doDeflate1_beast(beast_compressor, 1, 15, 8, 5, corpus1(1024));
+        doDeflate1_beast(beast_compressor, 1, 15, 8, 5, corpus2(50000));
+        doDeflate1_beast(beast_compressor, 1, 9, 1, 5, corpus3(50000));
+        doDeflate2_beast(beast_compressor, 1, 15, 8, 5, corpus1(56));
+        doDeflate2_beast(beast_compressor, 1, 15, 8, 5, std::string{});
+
+        // Every kind of flush between writes, and switching
+        // between the quick strategy and the others
+        auto const in = corpus3(200000);
+        for(auto flush : { Flush::none, Flush::block,
+            Flush::partial, Flush::sync, Flush::full })
+        {
+            deflate_stream ds;
+            ds.reset(1, 15, 8, Strategy::quick);
+            std::string out;
+            out.resize(ds.upper_bound(in.size()) + 5 * in.size() / 1000);
+            z_params zp{};
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            for(std::size_t pos = 0; pos < in.size(); pos += 5000)
+            {
+                zp.next_in = in.data() + pos;
+                zp.avail_in = (std::min<std::size_t>)(5000, in.size() - pos);
+                ds.write(zp, flush, ec);
+                BOOST_TEST(! ec);
+                if(pos == 50000)
+                {
+                    ds.params(zp, 6, Strategy::normal, ec);
+                    BOOST_TEST(! ec);
+                }
+                else if(pos == 100000)
+                {
+                    ds.params(zp, 6, Strategy::quick, ec);
+                    BOOST_TEST(! ec);
+                }
+            }
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == in);
+        }
+
+        // A single probe per position
+        deflate_stream ds;
+        ds.reset(1, 15, 8, Strategy::quick);
+        std::string out;
+        out.resize(ds.upper_bound(in.size()));
+        z_params zp{};
+        zp.next_in = in.data();
+        zp.avail_in = in.size();
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        error_code ec;
+        ds.write(zp, Flush::finish, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        out.resize(zp.total_out);
+        BOOST_TEST(decompress(out) == in);
+        BOOST_TEST(out.size() < in.size() / 2);
+        BOOST_TEST(ds.stats().searches > 0);
+        BOOST_TEST(ds.stats().chain_links <= ds.stats().searches);
+        BOOST_TEST(ds.stats().max_chain == 1);
+    }
+
+    static
+    void testMatchFinder()
+    {
+        auto const deflate = [](
+            std::string const& in, int level, int windowBits,
+            MatchFinder f, deflate_stats& st)
+            {
+                deflate_stream ds;
+                ds.match_finder(f);
+                ds.reset(level, windowBits, 8, Strategy::normal);
+                std::string out;
+                out.resize(ds.upper_bound(in.size()));
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += 7000)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min<std::size_t>)(7000, in.size() - pos);
+                    ds.write(zp, Flush::none, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                st = ds.stats();
+                return out.size();
+            };
+
+        // Every level, with small windows to exercise the slide
+        deflate_stats st;
+        auto const in = corpus3(100000);
+        for(int level = 1; level <= compression::max_level; ++level)
+        {
+            for(int windowBits : { 9, 15 })
+                deflate(in, level, windowBits, MatchFinder::binary_tree, st);
+        }
+
+        // Input which ends inside a match, and changes of level,
+        // keep the tree sorted
+        {
+            auto const mixed = corpus1(30000) + in + corpus1(30000);
+            deflate_stream ds;
+            ds.match_finder(MatchFinder::binary_tree);
+            ds.reset(6, 15, 8, Strategy::normal);
+            std::string out;
+            out.resize(ds.upper_bound(mixed.size()) + mixed.size() / 50);
+            z_params zp{};
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            int const levels[] = { 12, 4, 11, 6, 10, 9 };
+            for(std::size_t pos = 0; pos < mixed.size(); pos += 1000)
+            {
+                zp.next_in = mixed.data() + pos;
+                zp.avail_in = (std::min<std::size_t>)(1000, mixed.size() - pos);
+                ds.write(zp, Flush::sync, ec);
+                BOOST_TEST(! ec);
+                if(pos % 25000 == 0)
+                {
+                    ds.params(zp, levels[pos / 25000 % 6], Strategy::normal, ec);
+                    BOOST_TEST(! ec);
+                }
+            }
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == mixed);
+        }
+
+        // The tree finds the matches of the optimal parser
+        // with a fraction of the work of the hash chains
+        for(int level = compression::optimal_size;
+            level <= compression::max_level; ++level)
+        {
+            deflate_stats chain;
+            auto const size = deflate(in, level, 15,
+                MatchFinder::hash_chain, chain);
+            BOOST_TEST(deflate(in, level, 15,
+                MatchFinder::automatic, st) < size + size / 100);
+            BOOST_TEST(st.chain_links < chain.chain_links);
+        }
+
+        // Bounded work on highly repetitive input
+        std::string rep;
+        std::mt19937 g;
+        while(rep.size() < 200000)
+            rep.push_back("ab"[g() % 2]);
+        deflate_stats chain;
+        deflate(rep, 9, 15, MatchFinder::hash_chain, chain);
+        deflate(rep, 9, 15, MatchFinder::binary_tree, st);
+        BOOST_TEST(st.max_chain <= 16 + 4096 / 16);
+        BOOST_TEST(st.chain_links < chain.chain_links / 4);
+    }
+
+    static
+    void testMedium()
+    {
+        auto const deflate = [](
+            std::string const& in, int level, int windowBits,
+            int memLevel, bool medium, Flush flush)
+            {
+                deflate_stream ds;
+                ds.medium(medium);
+                ds.reset(level, windowBits, memLevel, Strategy::normal);
+                std::string out;
+                out.resize(ds.upper_bound(in.size()) + 6 * in.size() / 3000);
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += 3000)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min<std::size_t>)(3000, in.size() - pos);
+                    ds.write(zp, flush, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return out.size();
+            };
+
+        // Every kind of flush, with small windows and buffers
+        auto const in = corpus3(150000);
+        for(int level = 4; level <= 6; ++level)
+        {
+            for(auto flush : { Flush::none, Flush::block,
+                Flush::partial, Flush::sync, Flush::full })
+                deflate(in, level, 9, 1, true, flush);
+            deflate(corpus2(50000), level, 15, 8, true, Flush::none);
+        }
+
+        // Close to the size of the lazy evaluation
+        for(int level = 4; level <= 6; ++level)
+        {
+            auto const size = deflate(in, level, 15, 8, false, Flush::none);
+            auto const medium = deflate(in, level, 15, 8, true, Flush::none);
+            BOOST_TEST(medium < size + size / 20);
+        }
+
+        // Switching between the medium and the other compressors
+        {
+            deflate_stream ds;
+            ds.medium(true);
+            ds.reset(5, 15, 8, Strategy::normal);
+            std::string out;
+            out.resize(ds.upper_bound(in.size()));
+            z_params zp{};
+            zp.next_in = in.data();
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            for(int level : { 9, 1, 6 })
+            {
+                zp.avail_in = in.size() / 4;
+                ds.write(zp, Flush::none, ec);
+                BOOST_TEST(! ec);
+                ds.params(zp, level, Strategy::normal, ec);
+                BOOST_TEST(! ec);
+            }
+            zp.avail_in = in.size() - zp.total_in;
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == in);
+        }
+
+        // The other levels are unchanged
+        for(int level : { 3, 7 })
+            BOOST_TEST(
+                deflate(in, level, 15, 8, true, Flush::none) ==
+                deflate(in, level, 15, 8, false, Flush::none));
+    }
+
+    // Compress in chunks of 5000 bytes, each written with flush
+    static
+    std::string
+    deflateChunks(deflate_stream& ds, std::string const& in, Flush flush)
+    {
+        std::string out;
+        out.resize(ds.upper_bound(in.size()) + 12 * in.size() / 5000);
+        z_params zp{};
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        error_code ec;
+        for(std::size_t pos = 0; pos < in.size(); pos += 5000)
+        {
+            zp.next_in = in.data() + pos;
+            zp.avail_in = (std::min<std::size_t>)(5000, in.size() - pos);
+            ds.write(zp, flush, ec);
+            BOOST_TEST(! ec);
+        }
+        ds.write(zp, Flush::finish, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        out.resize(zp.total_out);
+        BOOST_TEST(decompress(out) == in);
+        return out;
+    }
+
+    // Every level, with a small symbol buffer and flushes
+    template<class Setup>
+    static
+    void
+    deflateLevels(std::string const& in, Setup const& setup)
+    {
+        for(int level = 0; level <= compression::max_level; ++level)
+        {
+            for(int memLevel : { 1, 8 })
+            {
+                deflate_stream ds;
+                setup(ds);
+                ds.reset(level, 15, memLevel, Strategy::normal);
+                deflateChunks(ds, in,
+                    memLevel == 1 ? Flush::none : Flush::sync);
+            }
+        }
+    }
+
+    void testBlockSplit()
+    {
+        auto const deflate = [](
+            std::string const& in, int level, bool split)
+            {
+                deflate_stream ds;
+                ds.block_split(split);
+                ds.reset(level, 15, 8, Strategy::normal);
+                return deflateChunks(ds, in, Flush::none).size();
+            };
+
+        // Text with runs of a different alphabet and random data
+        std::string in;
+        for(int i = 0; i < 3; ++i)
+        {
+            in += corpus3(40000 + 10000 * i);
+            in += corpus1(30000);
+            in += corpus2(5000 + 5000 * i);
+        }
+
+        deflateLevels(in, [](deflate_stream& ds)
+            {
+                ds.block_split(true);
+            });
+
+        // Separate codes for each part give smaller output
+        for(int level : { 1, 6, 9 })
+            BOOST_TEST(deflate(in, level, true) < deflate(in, level, false));
+
+        // Uniform data is left in full blocks
+        auto const text = corpus3(200000);
+        BOOST_TEST(
+            deflate(text, 6, true) <= deflate(text, 6, false) + 100);
+    }
+
+    void testReuseTrees()
+    {
+        // Text, then data whose codes the saved trees lack
+        std::string in;
+        for(int i = 0; i < 3; ++i)
+        {
+            in += corpus3(60000);
+            in += corpus1(20000);
+        }
+        deflateLevels(in, [](deflate_stream& ds)
+            {
+                ds.reuse_trees(true);
+            });
+
+        // Log lines repeat their trees, and cost little more
+        std::string text;
+        std::mt19937 g;
+        while(text.size() < 2000000)
+        {
+            static char const* const levels[] = {
+                "INFO", "WARN", "DEBUG", "ERROR" };
+            text += "2020-06-" + std::to_string(10 + g() % 20) +
+                " [" + levels[g() % 4] + "] worker-" +
+                std::to_string(g() % 16) + ": request id=" +
+                std::to_string(g()) + " latency=" +
+                std::to_string(g() % 5000) + "ms\n";
+        }
+        for(int level : { 1, 6, 9 })
+        {
+            deflate_stream ds;
+            ds.reset(level, 15, 8, Strategy::normal);
+            auto const fresh = deflateChunks(ds, text, Flush::none);
+            ds.reuse_trees(true);
+            ds.reset(level, 15, 8, Strategy::normal);
+            auto const reused = deflateChunks(ds, text, Flush::none);
+            BOOST_TEST(reused != fresh);
+            BOOST_TEST(reused.size() <= fresh.size() + fresh.size() / 100);
+        }
+    }
+
+    // Small blocks are typed from their frequencies before
+    // building trees, with the same output as zlib.
+    void testBlockTypes()
+    {
+        std::mt19937 g;
+        auto const text = corpus3(100000);
+        std::string random;
+        while(random.size() < 100000)
+            random += static_cast<char>(g());
+
+        for(int level = 1; level <= 9; ++level)
+        {
+            z_stream zs{};
+            deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            deflate_stream ds;
+            ds.reset(level, 15, 8, Strategy::normal);
+
+            // Messages of all sizes, each flushed
+            std::size_t pos = 0;
+            for(std::size_t size = 1; pos + size <= text.size();
+                size = size * 3 / 2 + 1)
+            {
+                std::string expected(size + 64, 0);
+                zs.next_in = (Bytef*)&text[pos];
+                zs.avail_in = static_cast<uInt>(size);
+                zs.next_out = (Bytef*)&expected[0];
+                zs.avail_out = static_cast<uInt>(expected.size());
+                ::deflate(&zs, Z_SYNC_FLUSH);
+                expected.resize(expected.size() - zs.avail_out);
+
+                std::string out(size + 64, 0);
+                z_params zp{};
+                zp.next_in = &text[pos];
+                zp.avail_in = size;
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                ds.write(zp, Flush::sync, ec);
+                BOOST_TEST(! ec);
+                out.resize(zp.total_out);
+                BOOST_TEST(out == expected);
+                pos += size;
+            }
+            deflateEnd(&zs);
+            BOOST_TEST(ds.stats().static_blocks > 0);
+            BOOST_TEST(ds.stats().dynamic_blocks > 0);
+
+            auto const count = [&](std::string const& in)
+                {
+                    ds.reset();
+                    std::string out(ds.upper_bound(in.size()), 0);
+                    z_params zp{};
+                    zp.next_in = in.data();
+                    zp.avail_in = in.size();
+                    zp.next_out = &out[0];
+                    zp.avail_out = out.size();
+                    error_code ec;
+                    ds.write(zp, Flush::finish, ec);
+                    BOOST_TEST(ec == error::end_of_stream);
+                    return ds.stats();
+                };
+            auto const random_stats = count(random);
+            BOOST_TEST(random_stats.stored_blocks > 0);
+            BOOST_TEST(random_stats.static_blocks == 0);
+            BOOST_TEST(random_stats.dynamic_blocks == 0);
+            auto const text_stats = count(text);
+            BOOST_TEST(text_stats.stored_blocks == 0);
+            BOOST_TEST(text_stats.dynamic_blocks > 0);
+        }
+    }
+
+    // Large blocks hold sixteen times as many symbols, whose
+    // frequencies no longer fit 16 bits.
+    void testLargeBlocks()
+    {
+        auto const deflate = [](
+            std::string const& in, int level, bool large)
+            {
+                deflate_stream ds;
+                ds.large_blocks(large);
+                ds.reset(level, 15, 8, Strategy::huffman);
+                deflateChunks(ds, in, Flush::none);
+                return ds.stats();
+            };
+
+        std::string in;
+        for(int i = 0; i < 3; ++i)
+        {
+            in += corpus3(60000);
+            in += corpus1(20000);
+        }
+        deflateLevels(in, [](deflate_stream& ds)
+            {
+                ds.large_blocks(true);
+            });
+
+        // Literals of one byte count more than 64K of one symbol
+        std::string const run(1000000, 'a');
+        for(int level : { 1, 6, 9 })
+        {
+            auto const small = deflate(run, level, false);
+            auto const large = deflate(run, level, true);
+            BOOST_TEST(large.dynamic_blocks + large.static_blocks <
+                small.dynamic_blocks + small.static_blocks);
+        }
+
+        // Incompressible data stays within the bound, also when a
+        // block is longer than the window of 32 bit positions
+        std::mt19937 g;
+        std::string random;
+        while(random.size() < 300000)
+            random += static_cast<char>(g());
+        for(int level : { 1, 6, 9, 12 })
+        {
+            for(bool on : { false, true })
+            {
+                for(int windowBits : { 12, 15 })
+                {
+                    deflate_stream ds;
+                    ds.large_blocks(true);
+                    ds.long_positions(on);
+                    ds.reset(level, windowBits, 8, Strategy::normal);
+                    deflateChunks(ds, random, Flush::none);
+                }
+            }
+        }
+
+        // The setting is kept across a reset
+        deflate_stream ds;
+        ds.large_blocks(true);
+        ds.reset(6, 15, 8, Strategy::normal);
+        ds.reset();
+        BOOST_TEST(ds.upper_bound(1000) > 1000 + 1000 / 8);
+    }
+
+    // Each chunk is compressed by the engine suited to it
+    void testAdaptive()
+    {
+        std::mt19937 g;
+        std::string in;
+        for(int i = 0; i < 2; ++i)
+        {
+            in += corpus3(70000);
+            in += std::string(50000, static_cast<char>('a' + i));
+            while(in.size() % 150000 != 0)
+                in += static_cast<char>(g());
+            in += corpus1(40000);
+        }
+
+        auto const deflate = [&](
+            int level, std::size_t chunk, Flush flush)
+            {
+                deflate_stream ds;
+                ds.reset(level, 15, 8, Strategy::adaptive);
+                std::string out(ds.upper_bound(in.size()) +
+                    6 * (in.size() / chunk + 1), 0);
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += chunk)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min)(chunk, in.size() - pos);
+                    ds.write(zp, flush, ec);
+                    BOOST_TEST(! ec);
+                    BOOST_TEST(zp.avail_in == 0);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return ds.stats();
+            };
+
+        for(int level = 0; level <= compression::max_level; ++level)
+        {
+            auto const stats = deflate(level, in.size(), Flush::none);
+            BOOST_TEST(stats.stored_blocks > 0);
+            if(level > 0)
+                BOOST_TEST(stats.dynamic_blocks > 0);
+            deflate(level, 1000, Flush::none);
+            deflate(level, 7000, Flush::sync);
+        }
+
+        // Storing the random bytes costs nothing in size
+        {
+            auto const size = [&](Strategy strategy)
+                {
+                    deflate_stream ds;
+                    ds.reset(6, 15, 8, strategy);
+                    std::string out(ds.upper_bound(in.size()), 0);
+                    z_params zp{};
+                    zp.next_in = in.data();
+                    zp.avail_in = in.size();
+                    zp.next_out = &out[0];
+                    zp.avail_out = out.size();
+                    error_code ec;
+                    ds.write(zp, Flush::finish, ec);
+                    BOOST_TEST(ec == error::end_of_stream);
+                    return zp.total_out;
+                };
+            BOOST_TEST(size(Strategy::adaptive) <= size(Strategy::normal));
+        }
+
+        // Switching to and from the strategy in the middle of a stream
+        for(auto const strategy : { Strategy::normal, Strategy::rle,
+            Strategy::huffman, Strategy::quick })
+        {
+            deflate_stream ds;
+            ds.reset(6, 15, 8, strategy);
+            std::string out(2 * in.size(), 0);
+            z_params zp{};
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            std::size_t const third = in.size() / 3;
+            for(int i = 0; i < 3; ++i)
+            {
+                zp.next_in = in.data() + i * third;
+                zp.avail_in = i < 2 ? third : in.size() - 2 * third;
+                ds.write(zp, Flush::none, ec);
+                BOOST_TEST(! ec);
+                if(i < 2)
+                {
+                    ds.params(zp, i == 0 ? 6 : 2,
+                        i == 0 ? Strategy::adaptive : strategy, ec);
+                    BOOST_TEST(! ec);
+                }
+            }
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == in);
+        }
+    }
+
+    // Incompressible chunks are stored without searching them
+    void testStoreIncompressible()
+    {
+        std::mt19937 g;
+        std::string random;
+        while(random.size() < 200000)
+            random += static_cast<char>(g());
+        std::string in = corpus3(50000) + random + corpus1(50000);
+
+        auto const deflate = [](std::string const& in, int level,
+            Strategy strategy, bool on, std::size_t chunk)
+            {
+                deflate_stream ds;
+                ds.store_incompressible(on);
+                ds.reset(level, 15, 8, strategy);
+                std::string out(ds.upper_bound(in.size()) +
+                    6 * (in.size() / chunk + 1), 0);
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += chunk)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min)(chunk, in.size() - pos);
+                    ds.write(zp, Flush::none, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return ds.stats();
+            };
+
+        for(int level = 0; level <= compression::max_level; ++level)
+        {
+            deflate(in, level, Strategy::normal, true, in.size());
+            deflate(in, level, Strategy::filtered, true, 3000);
+            deflate(in, level, Strategy::fixed, true, 3000);
+        }
+
+        for(int level : { 1, 6, 9 })
+        {
+            auto const off = deflate(random, level,
+                Strategy::normal, false, random.size());
+            auto const on = deflate(random, level,
+                Strategy::normal, true, random.size());
+            BOOST_TEST(off.searches > random.size() / 2);
+            BOOST_TEST(on.searches == 0);
+            BOOST_TEST(on.stored_blocks > 0);
+            BOOST_TEST(on.dynamic_blocks + on.static_blocks == 0);
+
+            // Compressible chunks are still searched
+            BOOST_TEST(deflate(in, level,
+                Strategy::normal, true, in.size()).searches > 0);
+        }
+    }
+
+    // Blocks written to the caller's buffer or through the pending buffer
+    void testDirectOutput()
+    {
+        std::mt19937 g;
+        std::string in = corpus3(100000);
+        while(in.size() < 150000)
+            in += static_cast<char>(g());
+        in += std::string(30000, 'a') + corpus1(50000);
+
+        auto const deflate = [&](int level, Strategy strategy,
+            std::size_t out_size, Flush flush,
+            int windowBits = 15, int memLevel = 8)
+            {
+                deflate_stream ds;
+                ds.reset(level, windowBits, memLevel, strategy);
+                std::string out;
+                // Nothing may be written past avail_out
+                std::string const sentinel(16, '\xa5');
+                std::string buf(out_size, 0);
+                buf += sentinel;
+                z_params zp{};
+                zp.avail_out = 1;
+                std::size_t pos = 0;
+                error_code ec;
+                for(;;)
+                {
+                    // New input once the last call had room to finish
+                    if(zp.avail_in == 0 && zp.avail_out != 0)
+                    {
+                        zp.next_in = in.data() + pos;
+                        zp.avail_in = (std::min<std::size_t>)(
+                            in.size() - pos, 20000);
+                        pos += zp.avail_in;
+                    }
+                    zp.next_out = &buf[0];
+                    zp.avail_out = out_size;
+                    ds.write(zp, pos == in.size() ?
+                        Flush::finish : flush, ec);
+                    BOOST_TEST(buf.compare(out_size,
+                        sentinel.size(), sentinel) == 0);
+                    out.append(buf.data(), out_size - zp.avail_out);
+                    if(ec == error::end_of_stream)
+                        break;
+                    BOOST_TEST(! ec || ec == error::need_buffers);
+                }
+                BOOST_TEST(decompress(out) == in);
+                return out;
+            };
+
+        for(int level = 0; level <= 9; ++level)
+        {
+            for(auto const strategy : { Strategy::normal,
+                Strategy::fixed, Strategy::huffman, Strategy::rle })
+            {
+                for(auto const flush : { Flush::none, Flush::sync })
+                {
+                    // Stored blocks take the size of the output, see testStored
+                    auto const large = deflate(level, strategy,
+                        deflate_stream{}.upper_bound(in.size()), flush);
+                    auto const small = deflate(level, strategy, 1000, flush);
+                    auto const tiny = deflate(level, strategy, 17, flush);
+                    if(level == 0 && strategy != Strategy::huffman &&
+                        strategy != Strategy::rle)
+                        continue;
+                    BOOST_TEST(small == large);
+                    if(flush == Flush::none)
+                        BOOST_TEST(tiny == large);
+                }
+            }
+        }
+
+        // Level 0 blocks longer than the window, which are sent static
+        for(auto const strategy : { Strategy::huffman, Strategy::rle })
+            for(auto const out_size : { 100000, 1000, 17 })
+                deflate(0, strategy, out_size, Flush::none, 9, 9);
+    }
+
+    // Stored blocks copied straight from the input are those of zlib
+    void testStored()
+    {
+        std::mt19937 g;
+        std::string in;
+        while(in.size() < 300000)
+            in += static_cast<char>(g());
+
+        auto const expected = [&](int windowBits, int memLevel,
+            std::size_t in_size, std::size_t out_size, int flush)
+            {
+                z_stream zs{};
+                deflateInit2(&zs, 0, Z_DEFLATED,
+                    windowBits, memLevel, Z_DEFAULT_STRATEGY);
+                std::string out;
+                std::string buf(out_size, 0);
+                std::size_t pos = 0;
+                zs.avail_out = 1;
+                for(;;)
+                {
+                    if(zs.avail_in == 0 && zs.avail_out != 0)
+                    {
+                        zs.next_in = (Bytef*)&in[pos];
+                        zs.avail_in = static_cast<uInt>(
+                            (std::min)(in.size() - pos, in_size));
+                        pos += zs.avail_in;
+                    }
+                    zs.next_out = (Bytef*)&buf[0];
+                    zs.avail_out = static_cast<uInt>(buf.size());
+                    auto const result = ::deflate(&zs,
+                        pos == in.size() ? Z_FINISH : flush);
+                    out.append(buf.data(), buf.size() - zs.avail_out);
+                    if(result == Z_STREAM_END)
+                        break;
+                }
+                deflateEnd(&zs);
+                return out;
+            };
+
+        auto const check = [&](int windowBits, int memLevel,
+            std::size_t in_size, std::size_t out_size, Flush flush)
+            {
+                deflate_stream ds;
+                ds.reset(0, windowBits, memLevel, Strategy::normal);
+                std::string out;
+                std::string buf(out_size, 0);
+                std::size_t pos = 0;
+                z_params zp{};
+                zp.avail_out = 1;
+                error_code ec;
+                for(;;)
+                {
+                    if(zp.avail_in == 0 && zp.avail_out != 0)
+                    {
+                        zp.next_in = &in[pos];
+                        zp.avail_in = (std::min)(in.size() - pos, in_size);
+                        pos += zp.avail_in;
+                    }
+                    zp.next_out = &buf[0];
+                    zp.avail_out = buf.size();
+                    ds.write(zp, pos == in.size() ? Flush::finish : flush, ec);
+                    out.append(buf.data(), buf.size() - zp.avail_out);
+                    if(ec == error::end_of_stream)
+                        break;
+                    BOOST_TEST(! ec || ec == error::need_buffers);
+                }
+                BOOST_TEST(out == expected(-windowBits, memLevel,
+                    in_size, out_size,
+                    flush == Flush::none ? Z_NO_FLUSH : Z_SYNC_FLUSH));
+            };
+
+        for(int windowBits : { 9, 15 })
+        {
+            for(int memLevel : { 1, 8 })
+            {
+                for(std::size_t in_size : { 1000, 50000, 300000 })
+                {
+                    for(std::size_t out_size : { 100, 7000, 400000 })
+                    {
+                        check(windowBits, memLevel, in_size, out_size,
+                            Flush::none);
+                        check(windowBits, memLevel, in_size, out_size,
+                            Flush::sync);
+                    }
+                }
+            }
+        }
+
+        // The hash is brought up to date when the level changes
+        for(int level : { 1, 6 })
+        {
+            deflate_stream ds;
+            ds.reset(0, 15, 8, Strategy::normal);
+            std::string const text = corpus1(100000);
+            std::string const data = text + in + text;
+            std::string out(2 * data.size(), 0);
+            z_params zp{};
+            zp.next_in = data.data();
+            zp.avail_in = 50000;
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = 120000;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            ds.params(zp, level, Strategy::normal, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = data.size() - 170000;
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == data);
+        }
+    }
+
+    // Hash chains of 32 bit positions, with a window which slides less often
+    void testLongPositions()
+    {
+        std::mt19937 g;
+        std::string in = corpus3(200000);
+        while(in.size() < 300000)
+            in += static_cast<char>(g());
+        in += corpus1(200000);
+
+        auto const deflate = [](deflate_stream& ds, std::string const& in,
+            std::size_t chunk)
+            {
+                std::string out(ds.upper_bound(in.size()) +
+                    6 * (in.size() / chunk + 1), 0);
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += chunk)
+                {
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min)(chunk, in.size() - pos);
+                    ds.write(zp, Flush::none, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return out;
+            };
+
+        auto const compress = [&](std::string const& in, int level,
+            int windowBits, Strategy strategy, bool on, std::size_t chunk,
+            int memLevel = 8)
+            {
+                deflate_stream ds;
+                ds.long_positions(on);
+                ds.reset(level, windowBits, memLevel, strategy);
+                return deflate(ds, in, chunk);
+            };
+
+        // The window of 32K positions is slid once in this input
+        std::string big = in;
+        while(big.size() < 1200000)
+            big += in;
+        for(int level : { 1, 6 })
+        {
+            auto const off = compress(big, level, 15,
+                Strategy::normal, false, 16384);
+            auto const on = compress(big, level, 15,
+                Strategy::normal, true, 16384);
+            BOOST_TEST(on.size() <= off.size() + off.size() / 1000);
+        }
+
+        for(int windowBits : { 9, 12 })
+        {
+            for(int level = 0; level <= 9; ++level)
+            {
+                for(std::size_t chunk : { in.size(), std::size_t{1000} })
+                {
+                    auto const off = compress(in, level, windowBits,
+                        Strategy::normal, false, chunk);
+                    auto const on = compress(in, level, windowBits,
+                        Strategy::normal, true, chunk);
+                    BOOST_TEST(on.size() <= off.size() + off.size() / 1000);
+                }
+            }
+            compress(in, 6, windowBits, Strategy::filtered, true, 3000);
+            compress(in, 6, windowBits, Strategy::rle, true, 3000);
+            compress(in, 6, windowBits, Strategy::adaptive, true, 3000);
+        }
+
+        // Level 0 blocks of the huffman and rle engines fit the pending
+        // buffer and the length of a stored block in the long window
+        {
+            std::string runs;
+            while(runs.size() < 100000)
+                runs += std::string(1 + g() % 300,
+                    static_cast<char>('a' + g() % 3));
+            for(auto const strategy : { Strategy::huffman, Strategy::rle })
+            {
+                compress(runs, 0, 12, strategy, true, 48000, 2);
+                compress(in, 0, 12, strategy, true, 48000, 2);
+                compress(runs, 0, 15, strategy, true, 48000, 9);
+                compress(in, 0, 15, strategy, true, 48000, 9);
+            }
+        }
+
+        // Blocks of incompressible data longer than a stored block
+        {
+            std::string random;
+            while(random.size() < 300000)
+                random += static_cast<char>(g());
+            for(int windowBits : { 9, 12, 14 })
+            {
+                for(int level : { 1, 4, 6, 9 })
+                {
+                    deflate_stream ds;
+                    ds.long_positions(true);
+                    ds.large_blocks(true);
+                    ds.reset(level, windowBits, 8, Strategy::normal);
+                    deflate(ds, random, 20000);
+                }
+            }
+        }
+
+        // The input held by level 0 is sent before params switches
+        for(int windowBits : { 12, 15 })
+        {
+            for(std::size_t out_size : { 300, 5000 })
+            {
+                deflate_stream ds;
+                ds.long_positions(true);
+                ds.reset(0, windowBits, 8, Strategy::normal);
+                std::string out;
+                std::string buf(out_size, 0);
+                z_params zp{};
+                zp.next_out = &buf[0];
+                zp.avail_out = out_size;
+                auto const take = [&]
+                    {
+                        out.append(buf.data(), out_size - zp.avail_out);
+                        zp.next_out = &buf[0];
+                        zp.avail_out = out_size;
+                    };
+                error_code ec;
+                zp.next_in = in.data();
+                zp.avail_in = 150000;
+                ds.write(zp, Flush::none, ec);
+                take();
+                for(int i = 0; i < 100000; ++i)
+                {
+                    ds.params(zp, 6, Strategy::normal, ec);
+                    take();
+                    if(ec != error::need_buffers)
+                        break;
+                }
+                BOOST_TEST(! ec);
+                zp.avail_in = 200000 - zp.total_in;
+                for(int i = 0; i < 100000; ++i)
+                {
+                    ds.write(zp, Flush::finish, ec);
+                    take();
+                    if(ec == error::end_of_stream)
+                        break;
+                }
+                BOOST_TEST(ec == error::end_of_stream);
+                BOOST_TEST(decompress(out) == in.substr(0, 200000));
+            }
+        }
+
+        // Engines without long positions ignore the setting
+        BOOST_TEST(compress(in, 10, 15, Strategy::normal, true, 5000) ==
+            compress(in, 10, 15, Strategy::normal, false, 5000));
+        BOOST_TEST(compress(in, 1, 15, Strategy::quick, true, 5000) ==
+            compress(in, 1, 15, Strategy::quick, false, 5000));
+
+        // The setting is kept across reset
+        {
+            deflate_stream ds;
+            ds.long_positions(true);
+            ds.reset(6, 9, 8, Strategy::normal);
+            auto const first = deflate(ds, in, 4000);
+            ds.reset();
+            BOOST_TEST(deflate(ds, in, 4000) == first);
+        }
+
+        // Levels which keep long positions can be switched to
+        {
+            deflate_stream ds;
+            ds.long_positions(true);
+            ds.reset(6, 9, 8, Strategy::normal);
+            std::string out(2 * in.size(), 0);
+            z_params zp{};
+            zp.next_in = in.data();
+            zp.avail_in = 100000;
+            zp.next_out = &out[0];
+            zp.avail_out = out.size();
+            error_code ec;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            ds.params(zp, 10, Strategy::normal, ec);
+            BOOST_TEST(ec == error::stream_error);
+            ec = {};
+            ds.params(zp, 1, Strategy::quick, ec);
+            BOOST_TEST(ec == error::stream_error);
+            ec = {};
+            ds.params(zp, 0, Strategy::normal, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = 200000;
+            ds.write(zp, Flush::none, ec);
+            BOOST_TEST(! ec);
+            ds.params(zp, 1, Strategy::normal, ec);
+            BOOST_TEST(! ec);
+            zp.avail_in = in.size() - 300000;
+            ds.write(zp, Flush::finish, ec);
+            BOOST_TEST(ec == error::end_of_stream);
+            out.resize(zp.total_out);
+            BOOST_TEST(decompress(out) == in);
+        }
+    }
+
+    // Fast levels tuned to send matches of four bytes or more
+    // Any engine may be switched to from any other in the middle
+    void testParamsSwitch()
+    {
+        std::mt19937 g;
+        std::string in = corpus3(60000);
+        while(in.size() < 80000)
+            in += static_cast<char>(g());
+        in += corpus1(40000);
+
+        struct engine
+        {
+            int level;
+            Strategy strategy;
+            bool medium;
+        };
+        engine const engines[] = {
+            { 0, Strategy::normal, false },
+            { 2, Strategy::normal, false },
+            { 5, Strategy::normal, true },
+            { 8, Strategy::normal, false },
+            { 11, Strategy::normal, false },
+            { 1, Strategy::quick, false },
+            { 6, Strategy::huffman, false },
+            { 6, Strategy::rle, false },
+            { 6, Strategy::adaptive, false } };
+
+        // A short output makes the switch wait for held input
+        auto const deflate = [&](engine const& from, engine const& to,
+            std::size_t out_size)
+            {
+                deflate_stream ds;
+                ds.medium(from.medium || to.medium);
+                ds.reset(from.level, 15, 8, from.strategy);
+                std::string out;
+                std::string buf(out_size, 0);
+                z_params zp{};
+                zp.next_out = &buf[0];
+                zp.avail_out = out_size;
+                auto const take = [&]
+                    {
+                        out.append(buf.data(), out_size - zp.avail_out);
+                        zp.next_out = &buf[0];
+                        zp.avail_out = out_size;
+                    };
+                error_code ec;
+                zp.next_in = in.data();
+                zp.avail_in = in.size() / 2;
+                while(zp.avail_in != 0)
+                {
+                    ds.write(zp, Flush::none, ec);
+                    BOOST_TEST(! ec || ec == error::need_buffers);
+                    take();
+                }
+                for(int i = 0; i < 100000; ++i)
+                {
+                    ds.params(zp, to.level, to.strategy, ec);
+                    take();
+                    if(ec != error::need_buffers)
+                        break;
+                }
+                BOOST_TEST(! ec);
+                zp.avail_in = in.size() - zp.total_in;
+                for(int i = 0; i < 100000; ++i)
+                {
+                    ds.write(zp, Flush::finish, ec);
+                    take();
+                    if(ec == error::end_of_stream)
+                        break;
+                    BOOST_TEST(! ec || ec == error::need_buffers);
+                }
+                BOOST_TEST(ec == error::end_of_stream);
+                BOOST_TEST(decompress(out) == in);
+            };
+
+        for(auto const& from : engines)
+            for(auto const& to : engines)
+                for(std::size_t out_size : { 200000, 37 })
+                    deflate(from, to, out_size);
+    }
+
+    void testMinLength()
+    {
+        std::string const in = corpus3(100000) + corpus1(100000);
+
+        auto const deflate = [&](int level, int min_length,
+            std::size_t chunk, int next_level)
+            {
+                deflate_stream ds;
+                ds.reset(level, 15, 8, Strategy::normal);
+                if(min_length != 0)
+                    ds.tune(4, 6, 32, 32, min_length);
+                std::string out(ds.upper_bound(in.size()) +
+                    6 * (in.size() / chunk + 1), 0);
+                z_params zp{};
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                for(std::size_t pos = 0; pos < in.size(); pos += chunk)
+                {
+                    if(pos >= in.size() / 2 && next_level != level)
+                    {
+                        ds.params(zp, next_level, Strategy::normal, ec);
+                        BOOST_TEST(! ec);
+                        level = next_level;
+                    }
+                    zp.next_in = in.data() + pos;
+                    zp.avail_in = (std::min)(chunk, in.size() - pos);
+                    ds.write(zp, Flush::none, ec);
+                    BOOST_TEST(! ec);
+                }
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out) == in);
+                return out;
+            };
+
+        for(int level = 1; level <= 3; ++level)
+        {
+            for(std::size_t chunk : { in.size(), std::size_t{1000} })
+            {
+                BOOST_TEST(deflate(level, 4, chunk, level) !=
+                    deflate(level, 3, chunk, level));
+                deflate(level, 4, chunk, level + 1);
+                deflate(level, 4, chunk, 6);
+            }
+        }
+
+        // The lazy levels only take 3
+        deflate_stream ds;
+        ds.reset(6, 15, 8, Strategy::normal);
+        BOOST_TEST_THROWS(
+            ds.tune(4, 4, 8, 4, 4),
+            std::invalid_argument);
+        ds.tune(4, 4, 8, 4, 3);
+        ds.reset(3, 15, 8, Strategy::normal);
+        ds.tune(4, 4, 8, 4, 4);
+        BOOST_TEST_THROWS(
+            ds.tune(4, 4, 8, 4, 5),
+            std::invalid_argument);
+        BOOST_TEST_THROWS(
+            ds.tune(4, 4, 8, 4, 2),
+            std::invalid_argument);
+    }
+
     static void testWrappedStream(){
         std::string raw = "This is fake content";
         auto test = [&](wrap wrap){
             std::string compr;
-            compr.resize(raw.size());
+            compr.resize(raw.size() + 32);
             auto ds = deflate_stream();
             ds.reset(6, 15, 8, Strategy::normal, wrap);
             z_params zp{};
@@ -608,11 +2117,45 @@ public:
             error_code ec;
             ds.write(zp, Flush::full, ec);
             BOOST_TEST(!ec);
-            BOOST_TEST(decompress(compr) == raw);
+            compr.resize(zp.total_out);
+            BOOST_TEST(decompress(compr, wrap) == raw);
         };
         test(boost::deflate::wrap::none);
         test(boost::deflate::wrap::zlib);
         test(boost::deflate::wrap::gzip);
+
+        // Only the strategies zlib calls fastest are labelled so
+        auto const header = [&](Strategy strategy, wrap wrap)
+            {
+                std::string out(64, 0);
+                deflate_stream ds;
+                ds.reset(6, 15, 8, strategy, wrap);
+                z_params zp{};
+                zp.next_in = raw.data();
+                zp.avail_in = raw.size();
+                zp.next_out = &out[0];
+                zp.avail_out = out.size();
+                error_code ec;
+                ds.write(zp, Flush::finish, ec);
+                BOOST_TEST(ec == error::end_of_stream);
+                out.resize(zp.total_out);
+                BOOST_TEST(decompress(out, wrap) == raw);
+                return wrap == boost::deflate::wrap::zlib ?
+                    (static_cast<unsigned char>(out[1]) >> 6) :
+                    static_cast<unsigned char>(out[8]);
+            };
+        for(auto strategy : { Strategy::huffman, Strategy::rle,
+            Strategy::fixed })
+        {
+            BOOST_TEST(header(strategy, wrap::zlib) == 0);
+            BOOST_TEST(header(strategy, wrap::gzip) == 4);
+        }
+        for(auto strategy : { Strategy::normal, Strategy::filtered,
+            Strategy::quick, Strategy::adaptive })
+        {
+            BOOST_TEST(header(strategy, wrap::zlib) == 2);
+            BOOST_TEST(header(strategy, wrap::gzip) == 0);
+        }
     }
 
     void
@@ -637,6 +2180,25 @@ public:
         testFlushAfterDistMatch(zlib_compressor);
         testFlushAfterDistMatch(beast_compressor);
         testWrappedStream();
+        testZlibIdentical();
+        testPrimeAndPending();
+        testHash();
+        testOptimal();
+        testMatchFinder();
+        testQuick();
+        testMedium();
+        testBlockSplit();
+        testReuseTrees();
+        testBlockTypes();
+        testLargeBlocks();
+        testAdaptive();
+        testStoreIncompressible();
+        testDirectOutput();
+        testStored();
+        testLongPositions();
+        testParamsSwitch();
+        testMinLength();
+        testBorrowedWindow();
     }
 };
 
@@ -696,6 +696,58 @@ public:
         test(boost::deflate::wrap::gzip);
     }
 
+    // The trailing checksum is verified whatever the output chunks are
+    static void testWrappedChecksums() {
+        std::string raw;
+        for(int i = 0; raw.size() < 100000; ++i)
+            raw += "checksum " + std::to_string(i * 7919 % 1000) + " ";
+        auto test = [&](wrap wrap, int windowBits, std::size_t chunk) {
+          int bits = wrap == boost::deflate::wrap::gzip ?
+              windowBits + 16 : windowBits;
+          z_stream zs{};
+          deflateInit2(&zs, 6, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY);
+          std::string in;
+          in.resize(deflateBound(&zs, static_cast<uLong>(raw.size())));
+          zs.next_in = (Bytef*)raw.data();
+          zs.avail_in = static_cast<uInt>(raw.size());
+          zs.next_out = (Bytef*)&in[0];
+          zs.avail_out = static_cast<uInt>(in.size());
+          BOOST_TEST(::deflate(&zs, Z_FINISH) == Z_STREAM_END);
+          in.resize(zs.total_out);
+          deflateEnd(&zs);
+
+          auto inflate = [&](std::string const& in) {
+              std::string out;
+              out.resize(raw.size());
+              z_params zp{};
+              zp.next_in = in.data();
+              zp.avail_in = in.size();
+              zp.next_out = &out[0];
+              inflate_stream is;
+              is.reset(windowBits, wrap, true);
+              error_code ec;
+              while(! ec)
+              {
+                  zp.avail_out = (std::min)(
+                      chunk, out.size() - zp.total_out);
+                  is.write(zp, Flush::none, ec);
+              }
+              BOOST_TEST(out == raw);
+              return ec;
+          };
+          BOOST_TEST(inflate(in) == error::end_of_stream);
+          in[in.size() - (wrap == boost::deflate::wrap::gzip ? 5 : 1)] ^= 1;
+          BOOST_TEST(inflate(in) == error::incorrect_data_check);
+        };
+        for(auto wrap : {boost::deflate::wrap::zlib, boost::deflate::wrap::gzip})
+          for(std::size_t chunk : {std::size_t{100}, std::size_t{1000},
+                                   std::size_t{5000}, std::size_t{200000}})
+          {
+            test(wrap, 10, chunk);
+            test(wrap, 15, chunk);
+          }
+    }
+
     static
     void testUncompressedFlushTrees(IDecompressor& d)
     {
@@ -736,6 +788,7 @@ public:
         testUncompressedFlushTrees(zlib_decompressor);
         testUncompressedFlushTrees(beast_decompressor);
         testWrappedStreams();
+        testWrappedChecksums();
     }
 };
 
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+// Test that header file is self-contained.
+#include <boost/deflate/detail/match_length.hpp>
+
+#include <array>
+#include <random>
+
+#include "test_suite.hpp"
+
+namespace boost {
+namespace deflate {
+namespace detail {
+
+class match_length_test {
+public:
+    using kernel = std::size_t(*)(
+        std::uint8_t const*, std::uint8_t const*, std::size_t);
+
+    // Every kernel must agree with the byte at a time reference
+    // for every mismatch position and every length limit.
+    static void check(kernel k) {
+        std::array<std::uint8_t, 300> a;
+        std::array<std::uint8_t, 300> b;
+        std::mt19937 g;
+        for(auto& c : a)
+            c = static_cast<std::uint8_t>(g());
+        for(std::size_t offset = 0; offset < 3; ++offset)
+        {
+            for(std::size_t pos = 0; pos <= 258; ++pos)
+            {
+                b = a;
+                if(pos + offset < b.size())
+                    b[pos + offset] ^= 0x40;
+                for(std::size_t n : {0, 1, 7, 8, 15, 16, 31, 32, 33, 256, 258})
+                {
+                    auto const expected = match_length_bytes(
+                        a.data() + offset, b.data() + offset, n);
+                    BOOST_TEST(k(a.data() + offset,
+                        b.data() + offset, n) == expected);
+                }
+            }
+        }
+    }
+
+    void run() {
+        check(&match_length_bytes);
+        check(&match_length_word);
+#ifdef BOOST_DEFLATE_USE_SSE2
+        check(&match_length_sse2);
+#endif
+#ifdef BOOST_DEFLATE_USE_AVX2
+        check(&match_length_avx2);
+#endif
+        check(&match_length);
+    }
+};
+
+TEST_SUITE(match_length_test, "match_length");
+
+} // detail
+} // deflate
+} // boost
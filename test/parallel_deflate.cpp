@@ -0,0 +1,279 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+// Test that header file is self-contained.
+#include <boost/deflate/parallel_deflate.hpp>
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_suite.hpp"
+#include "zlib-1.2.11/zlib.h"
+
+namespace boost {
+namespace deflate {
+
+class parallel_deflate_test
+{
+public:
+    // Text with repeats reaching back across chunk boundaries
+    static
+    std::string
+    corpus(std::size_t n)
+    {
+        static char const* const words[] = {
+            "alpha ", "beta ", "gamma ", "delta ", "epsilon ",
+            "zeta ", "eta ", "theta ", "iota ", "kappa\n" };
+        std::string s;
+        s.reserve(n);
+        std::mt19937 g;
+        while(s.size() < n)
+        {
+            if(s.size() > 1000 && g() % 4 == 0)
+            {
+                auto const len = 20 + g() % 200;
+                auto const pos = g() % (s.size() - len);
+                s.append(s, pos, len);
+            }
+            else
+            {
+                s.append(words[g() % 10]);
+            }
+        }
+        s.resize(n);
+        return s;
+    }
+
+    static
+    std::string
+    compress(
+        parallel_deflate& pd,
+        std::string const& in)
+    {
+        std::string out;
+        out.resize(pd.upper_bound(in.size()));
+        z_params zs{};
+        zs.next_in = in.data();
+        zs.avail_in = in.size();
+        zs.next_out = &out[0];
+        zs.avail_out = out.size();
+        error_code ec;
+        pd.write(zs, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        BOOST_TEST(zs.avail_in == 0);
+        BOOST_TEST(zs.total_in == in.size());
+        out.resize(zs.total_out);
+        return out;
+    }
+
+    static
+    std::string
+    decompress(std::string const& in, wrap format)
+    {
+        int const bits =
+            format == wrap::zlib ? 15 :
+            format == wrap::gzip ? 31 : -15;
+        z_stream zs{};
+        inflateInit2(&zs, bits);
+        std::string out;
+        out.resize(4 * in.size() + 1024);
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = static_cast<uInt>(in.size());
+        int result;
+        do
+        {
+            zs.next_out = (Bytef*)&out[zs.total_out];
+            zs.avail_out = static_cast<uInt>(out.size() - zs.total_out);
+            result = inflate(&zs, Z_FINISH);
+            if(result == Z_BUF_ERROR && zs.avail_out == 0)
+                out.resize(out.size() * 2);
+            else if(result != Z_STREAM_END)
+                break;
+        }
+        while(result != Z_STREAM_END);
+        BOOST_TEST(result == Z_STREAM_END);
+        BOOST_TEST(zs.avail_in == 0);
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+        return out;
+    }
+
+    void
+    testRoundTrip()
+    {
+        auto const in = corpus(300000);
+        for(auto format : { wrap::none, wrap::zlib, wrap::gzip })
+        {
+            for(int level : { 0, 1, 6, 9 })
+            {
+                parallel_deflate pd;
+                pd.reset(level, 8, Strategy::normal, format);
+                pd.chunk_size(64 * 1024);
+                BOOST_TEST(decompress(compress(pd, in), format) == in);
+            }
+            if(format == wrap::gzip)
+            {
+                // XFL tells of the slowest compression above level 8
+                for(int level : { 1, 6, 9, 10, 12 })
+                {
+                    parallel_deflate pd;
+                    pd.reset(level, 8, Strategy::normal, format);
+                    auto const out = compress(pd, in.substr(0, 1000));
+                    BOOST_TEST(out[8] == (level >= 9 ? 2 :
+                        level < 2 ? 4 : 0));
+                }
+
+                // and of the fastest only for the strategies zlib names
+                for(auto strategy : { Strategy::huffman, Strategy::rle,
+                    Strategy::quick, Strategy::adaptive })
+                {
+                    parallel_deflate pd;
+                    pd.reset(6, 8, strategy, format);
+                    auto const out = compress(pd, in.substr(0, 1000));
+                    BOOST_TEST(out[8] == (
+                        strategy == Strategy::huffman ||
+                        strategy == Strategy::rle ? 4 : 0));
+                }
+            }
+            for(std::size_t size : { 0, 1, 65536, 65537 })
+            {
+                parallel_deflate pd;
+                pd.reset(6, 8, Strategy::normal, format);
+                pd.chunk_size(65536);
+                auto const s = in.substr(0, size);
+                BOOST_TEST(decompress(compress(pd, s), format) == s);
+            }
+        }
+    }
+
+    void
+    testDeterministic()
+    {
+        auto const in = corpus(500000);
+        for(auto format : { wrap::none, wrap::gzip })
+        {
+            parallel_deflate pd;
+            pd.reset(6, 8, Strategy::normal, format);
+            pd.chunk_size(32 * 1024);
+            pd.concurrency(1);
+            auto const expected = compress(pd, in);
+            for(std::size_t n : { 2, 3, 8, 64 })
+            {
+                pd.concurrency(n);
+                BOOST_TEST(compress(pd, in) == expected);
+            }
+
+            // runs each task before returning
+            pd.executor([](std::function<void()> f) { f(); });
+            BOOST_TEST(compress(pd, in) == expected);
+
+            // runs each task on a new thread
+            pd.concurrency(4);
+            pd.executor(
+                [](std::function<void()> f)
+                {
+                    std::thread(std::move(f)).detach();
+                });
+            BOOST_TEST(compress(pd, in) == expected);
+        }
+    }
+
+    void
+    testExecutorThrows()
+    {
+        // The tasks submitted before the executor throws are
+        // waited for, and the exception reaches the caller.
+        auto const in = corpus(500000);
+        parallel_deflate pd;
+        pd.reset(6, 8, Strategy::normal, wrap::none);
+        pd.chunk_size(32 * 1024);
+        pd.concurrency(4);
+        std::size_t count = 0;
+        pd.executor(
+            [&count](std::function<void()> f)
+            {
+                if(++count == 3)
+                    throw std::runtime_error("executor");
+                std::thread(std::move(f)).detach();
+            });
+        std::string out(in.size() * 2, 0);
+        z_params zs{};
+        zs.next_in = in.data();
+        zs.avail_in = in.size();
+        zs.next_out = &out[0];
+        zs.avail_out = out.size();
+        error_code ec;
+        BOOST_TEST_THROWS(pd.write(zs, ec), std::runtime_error);
+
+        // The stream is still usable with a working executor
+        pd.executor([](std::function<void()> f) { f(); });
+        BOOST_TEST(decompress(compress(pd, in), wrap::none) == in);
+    }
+
+    void
+    testDictionary()
+    {
+        // Priming with the previous chunk must keep matches
+        // which reach back across the boundary.
+        auto const in = corpus(400000);
+        parallel_deflate pd;
+        pd.reset(6, 8, Strategy::normal, wrap::none);
+        pd.chunk_size(16 * 1024);
+        auto const chunked = compress(pd, in);
+        pd.chunk_size(in.size());
+        auto const whole = compress(pd, in);
+        BOOST_TEST(chunked.size() < whole.size() + whole.size() / 20);
+    }
+
+    void
+    testNeedBuffers()
+    {
+        auto const in = corpus(100000);
+        parallel_deflate pd;
+        std::string out(100, 0);
+        z_params zs{};
+        zs.next_in = in.data();
+        zs.avail_in = in.size();
+        zs.next_out = &out[0];
+        zs.avail_out = out.size();
+        error_code ec;
+        pd.write(zs, ec);
+        BOOST_TEST(ec == error::need_buffers);
+        BOOST_TEST(zs.avail_in == in.size());
+        BOOST_TEST(zs.total_out == 0);
+    }
+
+    void
+    testInvalidArgs()
+    {
+        parallel_deflate pd;
+        BOOST_TEST_THROWS(pd.reset(compression::max_level + 1, 8, Strategy::normal), std::invalid_argument);
+        BOOST_TEST_THROWS(pd.reset(6, 0, Strategy::normal), std::invalid_argument);
+        BOOST_TEST_THROWS(pd.chunk_size(0), std::invalid_argument);
+    }
+
+    void
+    run()
+    {
+        testRoundTrip();
+        testDeterministic();
+        testExecutorThrows();
+        testDictionary();
+        testNeedBuffers();
+        testInvalidArgs();
+    }
+};
+
+TEST_SUITE(parallel_deflate_test, "parallel_deflate");
+
+} // deflate
+} // boost
@@ -0,0 +1,428 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+// Test that header file is self-contained.
+#include <boost/deflate/prepared_dictionary.hpp>
+
+#include <boost/deflate/deflate_stream.hpp>
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_suite.hpp"
+#include "zlib-1.2.11/zlib.h"
+
+namespace boost {
+namespace deflate {
+
+class prepared_dictionary_test
+{
+public:
+    // Small JSON messages with the same keys and similar values
+    static
+    std::string
+    message(std::mt19937& g)
+    {
+        static char const* const names[] = {
+            "temperature", "pressure", "humidity", "voltage" };
+        std::string s = "{\"id\":" + std::to_string(g() % 100000) +
+            ",\"sensor\":\"" + names[g() % 4] +
+            "\",\"value\":" + std::to_string(g() % 1000) +
+            ",\"status\":\"" + (g() % 8 ? "ok" : "degraded") +
+            "\",\"tags\":[\"site-" + std::to_string(g() % 16) +
+            "\",\"rack-" + std::to_string(g() % 64) + "\"]}";
+        return s;
+    }
+
+    static
+    std::string
+    dictionary(std::size_t n)
+    {
+        std::mt19937 g(7);
+        std::string s;
+        while(s.size() < n)
+            s += message(g);
+        s.resize(n);
+        return s;
+    }
+
+    // Compress in, after setting the dictionary with `set`
+    template<class Set>
+    static
+    std::string
+    compress(
+        std::string const& in,
+        int level, int windowBits, int memLevel,
+        Set const& set, wrap format = wrap::none)
+    {
+        deflate_stream ds;
+        ds.reset(level, windowBits, memLevel, Strategy::normal, format);
+        error_code ec;
+        set(ds, ec);
+        BOOST_TEST(! ec);
+        std::string out;
+        out.resize(ds.upper_bound(in.size()) + 64);
+        z_params zp{};
+        zp.next_in = in.data();
+        zp.avail_in = in.size();
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        ds.write(zp, Flush::finish, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        out.resize(zp.total_out);
+        return out;
+    }
+
+    static
+    std::string
+    compress(
+        std::string const& in,
+        int level, int windowBits, int memLevel,
+        std::string const& dict)
+    {
+        return compress(in, level, windowBits, memLevel,
+            [&](deflate_stream& ds, error_code& ec)
+            {
+                ds.set_dictionary(dict.data(), dict.size(), ec);
+            });
+    }
+
+    static
+    std::string
+    compress(
+        std::string const& in,
+        int level, int windowBits, int memLevel,
+        prepared_dictionary const& dict)
+    {
+        return compress(in, level, windowBits, memLevel,
+            [&](deflate_stream& ds, error_code& ec)
+            {
+                ds.set_dictionary(dict, ec);
+            });
+    }
+
+    static
+    std::string
+    zlib_compress(
+        std::string const& in,
+        int level, int windowBits, int memLevel,
+        std::string const& dict, wrap format = wrap::none)
+    {
+        z_stream zs{};
+        deflateInit2(&zs, level, Z_DEFLATED,
+            format == wrap::zlib ? windowBits : -windowBits,
+            memLevel, Z_DEFAULT_STRATEGY);
+        deflateSetDictionary(&zs, (Bytef const*)dict.data(),
+            static_cast<uInt>(dict.size()));
+        std::string out;
+        out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = static_cast<uInt>(in.size());
+        zs.next_out = (Bytef*)&out[0];
+        zs.avail_out = static_cast<uInt>(out.size());
+        ::deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return out;
+    }
+
+    static
+    std::string
+    decompress(std::string const& in, std::string const& dict)
+    {
+        z_stream zs{};
+        inflateInit2(&zs, -15);
+        inflateSetDictionary(&zs, (Bytef const*)dict.data(),
+            static_cast<uInt>(dict.size()));
+        std::string out;
+        out.resize(100000);
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = static_cast<uInt>(in.size());
+        zs.next_out = (Bytef*)&out[0];
+        zs.avail_out = static_cast<uInt>(out.size());
+        BOOST_TEST(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+        return out;
+    }
+
+    // Both overloads must give what zlib gives with the same dictionary
+    void
+    testZlibIdentical()
+    {
+        std::mt19937 g;
+        auto const dict = dictionary(20000);
+        prepared_dictionary const pd(dict.data(), dict.size(), 15, 8);
+        BOOST_TEST(pd.size() == dict.size());
+        for(int level = 1; level <= 9; ++level)
+        {
+            std::string in;
+            for(int i = 0; i < 3; ++i)
+                in += message(g);
+            auto const expected = zlib_compress(in, level, 15, 8, dict);
+            BOOST_TEST(compress(in, level, 15, 8, dict) == expected);
+            BOOST_TEST(compress(in, level, 15, 8, pd) == expected);
+            BOOST_TEST(decompress(expected, dict) == in);
+        }
+    }
+
+    // Streams the tables were not prepared for hash the bytes instead
+    void
+    testOtherParameters()
+    {
+        std::mt19937 g;
+        std::string in;
+        for(int i = 0; i < 20; ++i)
+            in += message(g);
+
+        auto const dict = dictionary(3000);
+        prepared_dictionary const pd(dict.data(), dict.size(), 15, 8);
+        BOOST_TEST(compress(in, 6, 15, 9, pd) ==
+            compress(in, 6, 15, 9, dict));
+        BOOST_TEST(compress(in, 6, 10, 8, pd) ==
+            compress(in, 6, 10, 8, dict));
+        BOOST_TEST(compress(in, 11, 15, 8, pd) ==
+            compress(in, 11, 15, 8, dict));
+        BOOST_TEST(decompress(
+            compress(in, 11, 15, 8, pd), dict) == in);
+
+        prepared_dictionary const pm(
+            dict.data(), dict.size(), 15, 8, Hash::multiplicative);
+        auto const multiplicative = [&](deflate_stream& ds, error_code& ec)
+        {
+            ds.hash(Hash::multiplicative);
+            ds.set_dictionary(pm, ec);
+        };
+        auto const out = compress(in, 6, 15, 8, multiplicative);
+        BOOST_TEST(out == compress(in, 6, 15, 8,
+            [&](deflate_stream& ds, error_code& ec)
+            {
+                ds.hash(Hash::multiplicative);
+                ds.set_dictionary(dict.data(), dict.size(), ec);
+            }));
+        BOOST_TEST(decompress(out, dict) == in);
+        BOOST_TEST(compress(in, 6, 15, 8, pm) ==
+            compress(in, 6, 15, 8, dict));
+
+        // Matches of four bytes hash differently than the tables
+        auto const four = [&](deflate_stream& ds, error_code& ec)
+        {
+            ds.tune(4, 4, 16, 8, 4);
+            ds.set_dictionary(pd, ec);
+        };
+        auto const tuned = compress(in, 1, 15, 8, four);
+        BOOST_TEST(tuned == compress(in, 1, 15, 8,
+            [&](deflate_stream& ds, error_code& ec)
+            {
+                ds.tune(4, 4, 16, 8, 4);
+                ds.set_dictionary(dict.data(), dict.size(), ec);
+            }));
+        BOOST_TEST(decompress(tuned, dict) == in);
+    }
+
+    // The zlib format takes a dictionary, gzip has none
+    void
+    testWrapped()
+    {
+        std::mt19937 g;
+        std::string in;
+        for(int i = 0; i < 5; ++i)
+            in += message(g);
+        for(std::size_t n : { 3000, 40000 })
+        {
+            auto const dict = dictionary(n);
+            prepared_dictionary const pd(dict.data(), dict.size(), 15, 8);
+
+            auto const expected =
+                zlib_compress(in, 6, 15, 8, dict, wrap::zlib);
+            auto const raw = compress(in, 6, 15, 8,
+                [&](deflate_stream& ds, error_code& ec)
+                {
+                    ds.set_dictionary(dict.data(), dict.size(), ec);
+                }, wrap::zlib);
+            BOOST_TEST(raw == expected);
+            auto const prepared = compress(in, 6, 15, 8,
+                [&](deflate_stream& ds, error_code& ec)
+                {
+                    ds.set_dictionary(pd, ec);
+                }, wrap::zlib);
+            BOOST_TEST(prepared == raw);
+
+            deflate_stream ds;
+            ds.reset(6, 15, 8, Strategy::normal, wrap::gzip);
+            error_code ec;
+            ds.set_dictionary(dict.data(), dict.size(), ec);
+            BOOST_TEST(ec == error::stream_error);
+            ec = {};
+            ds.set_dictionary(pd, ec);
+            BOOST_TEST(ec == error::stream_error);
+        }
+    }
+
+    // Dictionaries longer than the window, and too short to hash
+    void
+    testSizes()
+    {
+        std::mt19937 g;
+        std::string in;
+        for(int i = 0; i < 5; ++i)
+            in += message(g);
+        for(std::size_t n : { 0, 1, 2, 3, 4, 600, 40000 })
+        {
+            auto const dict = dictionary(n);
+            for(int windowBits : { 9, 15 })
+            {
+                prepared_dictionary const pd(
+                    dict.data(), dict.size(), windowBits, 8);
+                auto const expected =
+                    zlib_compress(in, 6, windowBits, 8, dict);
+                BOOST_TEST(
+                    compress(in, 6, windowBits, 8, dict) == expected);
+                BOOST_TEST(
+                    compress(in, 6, windowBits, 8, pd) == expected);
+            }
+        }
+        auto const big = dictionary(40000);
+        BOOST_TEST(prepared_dictionary(
+            big.data(), big.size(), 15, 8).size() ==
+                prepared_dictionary::max_size);
+        BOOST_TEST_THROWS(prepared_dictionary(
+            big.data(), big.size(), 16, 8), std::invalid_argument);
+    }
+
+    // One dictionary shared by streams on several threads
+    void
+    testShared()
+    {
+        auto const dict = dictionary(32768);
+        prepared_dictionary const pd(dict.data(), dict.size(), 15, 8);
+        std::vector<std::string> in(4);
+        std::vector<std::string> out(4);
+        std::mt19937 g;
+        for(auto& s : in)
+            for(int i = 0; i < 50; ++i)
+                s += message(g);
+        std::vector<std::thread> threads;
+        for(std::size_t i = 0; i < in.size(); ++i)
+            threads.emplace_back([&, i]
+            {
+                deflate_stream ds;
+                ds.reset(6, 15, 8, Strategy::normal);
+                for(int run = 0; run < 20; ++run)
+                {
+                    ds.reset();
+                    error_code ec;
+                    ds.set_dictionary(pd, ec);
+                    std::string s;
+                    s.resize(ds.upper_bound(in[i].size()));
+                    z_params zp{};
+                    zp.next_in = in[i].data();
+                    zp.avail_in = in[i].size();
+                    zp.next_out = &s[0];
+                    zp.avail_out = s.size();
+                    ds.write(zp, Flush::finish, ec);
+                    s.resize(zp.total_out);
+                    out[i] = s;
+                }
+            });
+        for(auto& t : threads)
+            t.join();
+        for(std::size_t i = 0; i < in.size(); ++i)
+        {
+            BOOST_TEST(out[i] == compress(in[i], 6, 15, 8, dict));
+            BOOST_TEST(decompress(out[i], dict) == in[i]);
+        }
+    }
+
+    // A dictionary after a flush is appended to the history
+    void
+    testAfterFlush()
+    {
+        std::mt19937 g;
+        auto const a = message(g);
+        auto const b = message(g);
+        auto const dict = dictionary(2000);
+        prepared_dictionary const pd(dict.data(), dict.size(), 15, 8);
+
+        deflate_stream ds;
+        ds.reset(6, 15, 8, Strategy::normal);
+        std::string out;
+        out.resize(1000);
+        z_params zp{};
+        zp.next_in = a.data();
+        zp.avail_in = a.size();
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        error_code ec;
+        ds.write(zp, Flush::none, ec);
+        BOOST_TEST(! ec);
+        ds.set_dictionary(pd, ec);
+        BOOST_TEST(ec == error::stream_error);
+        ec = {};
+        ds.write(zp, Flush::sync, ec);
+        BOOST_TEST(! ec);
+        ds.set_dictionary(pd, ec);
+        BOOST_TEST(! ec);
+        zp.next_in = b.data();
+        zp.avail_in = b.size();
+        ds.write(zp, Flush::finish, ec);
+        BOOST_TEST(ec == error::end_of_stream);
+        out.resize(zp.total_out);
+
+        z_stream zs{};
+        inflateInit2(&zs, -15);
+        std::string result;
+        result.resize(a.size() + b.size());
+        zs.next_in = (Bytef*)out.data();
+        zs.avail_in = static_cast<uInt>(out.size());
+        zs.next_out = (Bytef*)&result[0];
+        zs.avail_out = static_cast<uInt>(a.size());
+        inflate(&zs, Z_SYNC_FLUSH);
+        BOOST_TEST(zs.total_out == a.size());
+        inflateSetDictionary(&zs, (Bytef const*)dict.data(),
+            static_cast<uInt>(dict.size()));
+        zs.avail_out = static_cast<uInt>(b.size());
+        BOOST_TEST(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+        inflateEnd(&zs);
+        BOOST_TEST(result == a + b);
+
+        // The zlib header is written first, so it takes none after
+        ds.reset(6, 15, 8, Strategy::normal, wrap::zlib);
+        zp.next_in = a.data();
+        zp.avail_in = a.size();
+        zp.next_out = &out[0];
+        zp.avail_out = out.size();
+        ec = {};
+        ds.write(zp, Flush::sync, ec);
+        BOOST_TEST(! ec);
+        ds.set_dictionary(dict.data(), dict.size(), ec);
+        BOOST_TEST(ec == error::stream_error);
+        ec = {};
+        ds.set_dictionary(pd, ec);
+        BOOST_TEST(ec == error::stream_error);
+    }
+
+    void
+    run()
+    {
+        testZlibIdentical();
+        testOtherParameters();
+        testWrapped();
+        testSizes();
+        testShared();
+        testAfterFlush();
+    }
+};
+
+TEST_SUITE(prepared_dictionary_test, "prepared_dictionary");
+
+} // deflate
+} // boost
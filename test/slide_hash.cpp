@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2020 Ryan Janson (ryand.janson@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Official repository: https://github.com/ryanjanson/deflate
+//
+
+// Test that header file is self-contained.
+#include <boost/deflate/detail/slide_hash.hpp>
+
+#include <random>
+#include <vector>
+
+#include "test_suite.hpp"
+
+namespace boost {
+namespace deflate {
+namespace detail {
+
+class slide_hash_test {
+public:
+    // Every kernel must agree with the scalar reference for
+    // every length, including the tails shorter than a vector,
+    // and for the positions on either side of the window size.
+    static void check(slide_hash_kernel k) {
+        std::mt19937 g;
+        for(std::uint16_t wsize : {256, 4096, 32768})
+        {
+            std::vector<std::uint16_t> a(1000);
+            for(auto& m : a)
+            {
+                switch(g() % 4)
+                {
+                case 0: m = 0; break;
+                case 1: m = static_cast<std::uint16_t>(
+                    wsize - 1 + g() % 3); break;
+                default: m = static_cast<std::uint16_t>(
+                    g() % (2 * wsize)); break;
+                }
+            }
+            for(std::size_t n : {0, 1, 7, 8, 9, 15, 16, 17, 33, 999})
+            {
+                for(std::size_t offset = 0; offset < 2; ++offset)
+                {
+                    auto b = a;
+                    auto c = a;
+                    slide_hash_scalar(b.data() + offset, n, wsize);
+                    k(c.data() + offset, n, wsize);
+                    BOOST_TEST(b == c);
+                }
+            }
+        }
+    }
+
+    void run() {
+        check(&slide_hash_scalar);
+#ifdef BOOST_DEFLATE_USE_SSE2
+        check(&slide_hash_sse2);
+#endif
+#ifdef BOOST_DEFLATE_USE_AVX2
+        check(&slide_hash_avx2);
+#endif
+        check(select_slide_hash());
+        check(&slide_hash);
+    }
+};
+
+TEST_SUITE(slide_hash_test, "slide_hash");
+
+} // detail
+} // deflate
+} // boost